@@ -9,6 +9,29 @@
 #include <fstream>
 #include <filesystem>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <ctime>
+#include <random>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -23,6 +46,12 @@ static bool Quit = false;
 static bool WantsQuit = false;
 static bool WantsSave = false;
 static bool WantsLayout = true;
+static bool Headless = false;
+static bool IdleRendering = true;
+static int FrameRateCap = 60;
+static int MemoryBudget = 0; /* MiB, 0 for no limit */
+static bool VerifyOnSave = false;
+static bool PatchInPlace = false; /* off: every save goes through temporary files */
 
 static const unsigned int W = 800;
 static const unsigned int H = 500;
@@ -44,247 +73,2316 @@ static hx_entry* SelectedEvent = nullptr;
 static hx_entry* SelectedObject = nullptr;
 static int SelectedEntryIndex = 0;
 
+/* Entries edited since the last load or save */
+static std::set<hx_entry_t*> DirtyEntries;
+static bool DirtyStreams = false;
+
+/* Copies of entries edited while a worker reads the context */
+static std::map<hx_entry_t*, hx_event_resource_data_t> DeferredEventEdits;
+static std::map<hx_entry_t*, hx_wav_resource_data_t> DeferredWaveEdits;
+
 struct LogEntry {
   enum Type { Status, Info, Warning, Error} type;
   std::string text;
 };
 
-static struct std::vector<LogEntry> Log;
+static void RequestRedraw();
+
+/* Fixed-capacity ring that any thread may append to. A writer reserves a slot
+ * with a single fetch_add and publishes it through the slot's sequence number;
+ * readers only accept a slot whose sequence is unchanged across the copy, so
+ * values overwritten while being read are skipped instead of torn. */
+template <typename T, size_t N> class SeqRing {
+public:
+  static constexpr size_t Capacity = N;
+  
+  /* `fill` writes the value in place */
+  template <typename F> void Write(F fill) {
+    uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[index % Capacity];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    fill(slot.value);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+  }
+  
+  /* Copies value `index` into `out`. Fails if it is unpublished or was overwritten. */
+  bool Read(uint64_t index, T& out) const {
+    const Slot& slot = slots[index % Capacity];
+    uint64_t expected = 2 * index + 2;
+    if (slot.sequence.load(std::memory_order_acquire) != expected) return false;
+    out = slot.value;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == expected;
+  }
+  
+  uint64_t End() const { return head.load(std::memory_order_acquire); }
+  
+private:
+  struct Slot {
+    std::atomic<uint64_t> sequence = 0;
+    T value = {};
+  };
+  
+  Slot slots[Capacity];
+  std::atomic<uint64_t> head = 0;
+};
+
+/* Log that any thread may append to */
+class LogRing {
+public:
+  static constexpr size_t Capacity = 8192;
+  static constexpr size_t MaxLength = 512;
+  
+  void push_back(const LogEntry& entry) {
+    ring.Write([&](Line& line) {
+      line.type = entry.type;
+      size_t length = std::min(entry.text.length(), MaxLength - 1);
+      memcpy(line.text, entry.text.c_str(), length);
+      line.text[length] = '\0';
+    });
+    RequestRedraw();
+  }
+  
+  /* Copies entry `index` into `out`. Fails if it is unpublished or was overwritten. */
+  bool Read(uint64_t index, LogEntry::Type& type, char (&out)[MaxLength]) const {
+    Line line;
+    if (!ring.Read(index, line)) return false;
+    type = line.type;
+    memcpy(out, line.text, MaxLength);
+    return true;
+  }
+  
+  /* Index range currently held by the ring: [Begin(), End()). */
+  uint64_t Begin() const {
+    uint64_t end = End();
+    return std::max(first, end > Capacity ? end - Capacity : 0);
+  }
+  
+  uint64_t End() const { return ring.End(); }
+  
+  /* Main thread only */
+  void clear() { first = End(); }
+  
+private:
+  struct Line {
+    LogEntry::Type type;
+    char text[MaxLength];
+  };
+  
+  SeqRing<Line, Capacity> ring;
+  uint64_t first = 0;
+};
+
+static LogRing Log;
 
 static std::map<std::string, std::fstream*> FileMap;
+static std::mutex FileMutex;
 
-static bool IsResourceFile(std::filesystem::path p) {
-  return p.extension() == ".hst" || p.extension() == ".HST" ||
-  p.extension() == ".hos" || p.extension() == ".HOS";
-}
+#pragma mark - Task scheduler
 
-static std::fstream* FindOrCreateFileStream(std::filesystem::path p) {
-  std::string filename = work_directory.string() + p.filename().string();
-  if (FileMap.find(filename) != FileMap.end()) return FileMap[filename];
-  return FileMap[filename] = new std::fstream(filename, std::ios::binary | std::ios::in | std::ios::out);
-}
+/* One scheduler shared by the whole app. Every worker owns a deque per priority
+ * lane; a worker pops from the back of its own deque and steals from the front
+ * of the others, always draining the interactive lane before the batch lane. */
+enum class TaskPriority { Interactive, Batch };
 
-static char* ReadCB(const char* fn, size_t pos, size_t *size, void* userdata) {
-  std::string filename = fn;
-  std::filesystem::path path(fn);
+struct TaskToken : std::enable_shared_from_this<TaskToken> {
+  std::atomic<bool> cancelled = false;
+  std::atomic<bool> finished = false;
+};
+
+typedef std::shared_ptr<TaskToken> TaskHandle;
+
+class TaskScheduler {
+public:
+  typedef std::function<void(TaskToken&)> Function;
   
-  std::fstream *fs = FindOrCreateFileStream(path);
-    
-  if (fs->is_open()) {
-    fs->seekg(0, std::ios_base::end);
-    size_t real_size = fs->tellg();
-    if (*size > real_size) *size = real_size;
-    fs->seekg(pos);
-    
-    char* data = (char*)malloc(*size);
-    fs->read(data, *size);
-    
-    FileMap[filename] = fs;
-    
-    return data;
+  TaskScheduler(unsigned int num_workers) {
+    for (unsigned int i = 0; i < num_workers; i++) workers.push_back(std::make_unique<Worker>());
+    for (unsigned int i = 0; i < num_workers; i++) threads.emplace_back(&TaskScheduler::WorkerLoop, this, i);
   }
   
-  return nullptr;
-}
-
-static void WriteCB(const char* filename, void* data, size_t pos, size_t *size, void* userdata) {
-  std::filesystem::path path(filename);
-  std::fstream *fs = FindOrCreateFileStream(path);
+  ~TaskScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stop = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& t : threads) t.join();
+  }
   
-  if (fs->is_open()) {
-    fs->seekg(pos);
-    fs->write((char*)data, *size);
-    fs->close();
-  } else {
-    std::cerr << "err: " << strerror(errno) << "\n";
+  TaskHandle Submit(TaskPriority priority, Function fn) {
+    TaskHandle token = std::make_shared<TaskToken>();
+    unsigned int index = (CurrentWorker >= 0) ? CurrentWorker : next_worker++ % workers.size();
+    /* Counted before it is published, so a worker popping it right away cannot wrap the counter */
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      pending++;
+    }
+    {
+      std::lock_guard<std::mutex> lock(workers[index]->mutex);
+      workers[index]->lanes[int(priority)].push_back({ std::move(fn), token });
+    }
+    sleep_cv.notify_one();
+    return token;
   }
-}
+  
+  /* Blocks until the task has run (or was skipped after cancellation). If it is still
+   * queued it runs on the calling thread; unrelated tasks are never picked up here, so
+   * waiting on the main thread cannot end up running a whole bank load or save. */
+  void Wait(const TaskHandle& token) {
+    while (!token->finished) {
+      Task task;
+      if (Take(token, task)) {
+        Run(task);
+      } else {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait_for(lock, std::chrono::milliseconds(1), [&] { return token->finished.load(); });
+      }
+    }
+  }
+  
+  /* Splits [0, count) over the workers and waits for all of them. */
+  void ParallelFor(TaskPriority priority, size_t count, std::function<void(size_t)> fn) {
+    std::vector<TaskHandle> tasks;
+    size_t chunk = std::max<size_t>(1, count / (workers.size() * 4));
+    for (size_t begin = 0; begin < count; begin += chunk) {
+      size_t end = std::min(count, begin + chunk);
+      tasks.push_back(Submit(priority, [=](TaskToken& token) {
+        for (size_t i = begin; i < end && !token.cancelled; i++) fn(i);
+      }));
+    }
+    for (auto& t : tasks) Wait(t);
+  }
+  
+  size_t NumPending() const { return pending + running; }
+  unsigned int NumWorkers() const { return (unsigned int)workers.size(); }
+  
+private:
+  struct Task {
+    Function fn;
+    TaskHandle token;
+  };
+  
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> lanes[2];
+  };
+  
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::mutex sleep_mutex;
+  std::condition_variable sleep_cv;
+  std::mutex done_mutex;
+  std::condition_variable done_cv;
+  std::atomic<size_t> pending = 0;
+  std::atomic<size_t> running = 0;
+  std::atomic<unsigned int> next_worker = 0;
+  bool stop = false;
+  
+  static inline thread_local int CurrentWorker = -1;
+  
+  bool Pop(int self, Task& out) {
+    unsigned int n = (unsigned int)workers.size();
+    unsigned int first = (self >= 0) ? self : 0;
+    for (int lane = 0; lane < 2; lane++) {
+      for (unsigned int k = 0; k < n; k++) {
+        Worker& w = *workers[(first + k) % n];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.lanes[lane].empty()) continue;
+        if (k == 0 && self >= 0) {
+          out = std::move(w.lanes[lane].back());
+          w.lanes[lane].pop_back();
+        } else {
+          out = std::move(w.lanes[lane].front());
+          w.lanes[lane].pop_front();
+        }
+        running++;
+        pending--;
+        return true;
+      }
+    }
+    return false;
+  }
+  
+  /* Removes the task of `token` from whichever deque holds it */
+  bool Take(const TaskHandle& token, Task& out) {
+    for (auto& w : workers) {
+      std::lock_guard<std::mutex> lock(w->mutex);
+      for (auto& lane : w->lanes) {
+        auto it = std::find_if(lane.begin(), lane.end(), [&](const Task& t) { return t.token == token; });
+        if (it == lane.end()) continue;
+        out = std::move(*it);
+        lane.erase(it);
+        running++;
+        pending--;
+        return true;
+      }
+    }
+    return false;
+  }
+  
+  void Run(Task& task) {
+    if (!task.token->cancelled) task.fn(*task.token);
+    {
+      std::lock_guard<std::mutex> lock(done_mutex);
+      task.token->finished = true;
+      running--;
+    }
+    done_cv.notify_all();
+  }
+  
+  void WorkerLoop(unsigned int index) {
+    CurrentWorker = index;
+    while (true) {
+      Task task;
+      if (Pop(index, task)) {
+        Run(task);
+        continue;
+      }
+      
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleep_cv.wait(lock, [this] { return stop || pending > 0; });
+      if (stop) break;
+    }
+  }
+};
 
-static void ErrorCB(const char* str, void*) {
-  Log.push_back({ LogEntry::Type::Warning, str });
-}
+static std::unique_ptr<TaskScheduler> Scheduler;
 
-static std::string ConfigFile() {
-  std::filesystem::path path = BasePath;
-  if (!std::filesystem::exists(path)) std::filesystem::create_directory(path);
-  path += "/hxtool.cfg";
-  return path.string();
+static std::mutex MainThreadMutex;
+static std::vector<std::function<void()>> MainThreadQueue;
+/* Registered once SDL is up; load workers may already be running by then */
+static std::atomic<Uint32> WakeEventType = 0;
+
+/* Set from the first wakeup until the main loop runs again, so a burst of log lines or
+ * results posts a single event instead of flooding SDL's queue */
+static std::atomic<bool> WakePending = false;
+
+/* Wakes the main loop from SDL_WaitEventTimeout. Safe to call from any thread. */
+static void RequestRedraw() {
+  Uint32 type = WakeEventType;
+  if (type == 0 || type == (Uint32)-1) return;
+  if (WakePending.exchange(true)) return;
+  SDL_Event e;
+  SDL_memset(&e, 0, sizeof(e));
+  e.type = type;
+  SDL_PushEvent(&e);
 }
 
-static void SaveConfig() {
-  FILE *fp = fopen(ConfigFile().c_str(), "w");
-  fprintf(fp, "ThemeColor = %X\n", ImGui::ColorConvertFloat4ToU32(ColorCoefficients));
-  fprintf(fp, "BorderLess = %d\n", SDL_GetWindowFlags(Window) & SDL_WINDOW_BORDERLESS);
-  fclose(fp);
+/* Hands a result from a worker back to the UI thread. */
+static void RunOnMainThread(std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lock(MainThreadMutex);
+    MainThreadQueue.push_back(std::move(fn));
+  }
+  RequestRedraw();
 }
 
-static void LoadConfig() {
-  FILE *fp = fopen(ConfigFile().c_str(), "r");
-  if (!fp) return;
-  int color = 0xFFFFFFFF, borderless = 0;
-  fscanf(fp, "ThemeColor = %X\n", &color);
-  fscanf(fp, "BorderLess = %d\n", &borderless);
-  ColorCoefficients = ImGui::ColorConvertU32ToFloat4(color);
-  SDL_SetWindowBordered(Window, SDL_bool(!borderless));
-  fclose(fp);
+static void DispatchMainThreadTasks() {
+  WakePending = false;
+  std::vector<std::function<void()>> queue;
+  {
+    std::lock_guard<std::mutex> lock(MainThreadMutex);
+    queue.swap(MainThreadQueue);
+  }
+  for (auto& fn : queue) fn();
 }
 
-#pragma mark - Audio player
 
-static int AudioLength = 0;
-static int AudioPosition = 0;
-static int AudioPositionTotal = 0;
-static int AudioQueueIndex = 0;
-static bool AudioRepeat = false;
-static float AudioMixVolume = 0.5f;
+#pragma mark - Profiler
 
-static int AudioSampleRate = 0;
-static int AudioChannelCount = 0;
+static std::atomic<bool> ProfilerEnabled = false;
+static const std::chrono::steady_clock::time_point ProfileEpoch = std::chrono::steady_clock::now();
 
-static std::deque<hx_audio_stream*> AudioQueue;
-static std::deque<hx_audio_stream*> AudioSwapQueue;
+static uint64_t ProfileNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - ProfileEpoch).count();
+}
 
-static void AudioClear() {
-  for (auto& e : AudioQueue) {
-    hx_audio_stream_dealloc(e);
-    free(e);
+static uint32_t ProfileThreadId() {
+  static std::atomic<uint32_t> next = 0;
+  static thread_local uint32_t id = next++;
+  return id;
+}
+
+/* Completed zones, kept in the same kind of ring as the log so any thread can record */
+class ProfileRing {
+public:
+  static constexpr size_t Capacity = 1 << 16;
+  
+  struct Event {
+    const char* zone;
+    uint32_t thread;
+    uint64_t begin;
+    uint64_t end;
+  };
+  
+  void Record(const char* zone, uint64_t begin, uint64_t end) {
+    uint32_t thread = ProfileThreadId();
+    ring.Write([&](Event& e) { e = { zone, thread, begin, end }; });
   }
   
-  for (auto& e : AudioSwapQueue) {
-    hx_audio_stream_dealloc(e);
-    free(e);
+  void Snapshot(std::vector<Event>& out) const {
+    uint64_t end = ring.End();
+    uint64_t begin = end > Capacity ? end - Capacity : 0;
+    out.clear();
+    out.reserve(end - begin);
+    Event e;
+    for (uint64_t i = begin; i < end; i++) if (ring.Read(i, e)) out.push_back(e);
   }
   
-  AudioLength = 0;
-  AudioPositionTotal = 0;
-  AudioQueueIndex = 0;
-  AudioQueue.clear();
-  AudioSwapQueue.clear();
-}
+private:
+  SeqRing<Event, Capacity> ring;
+};
 
-static void AudioCallback(void*, Uint8 *stream, int len) {
-  SDL_memset(stream, 0, len);
+static ProfileRing Profile;
+
+struct ProfileScope {
+  const char* zone;
+  uint64_t begin;
   
-  unsigned int AudioRemaining = AudioLength - AudioPositionTotal;
-  len = (len > AudioRemaining ? AudioRemaining : len);
+  ProfileScope(const char* name) : zone(ProfilerEnabled ? name : nullptr), begin(zone ? ProfileNow() : 0) {}
+  ~ProfileScope() { if (zone) Profile.Record(zone, begin, ProfileNow()); }
+};
+
+#define PROFILE_ZONE(name) ProfileScope ProfileZone(name)
+
+static bool ProfilerOverlay = false;
+static uint64_t ProfileResetTime = 0;
+static float FrameTimes[240] = {};
+static int FrameTimeIndex = 0;
+
+#pragma mark - Load statistics
+
+/* Collected per context through the callback userdata. ReadCB updates
+ * it while holding FileMutex, so no extra locking is needed. */
+struct LoadStats {
+  struct File {
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+    uint64_t nanoseconds = 0;
+  };
   
-  if (len == 0) {
-    if (AudioRepeat) {
-      printf("repeat!\n");
-      AudioQueueIndex = 0;
-      AudioPosition = 0;
-      AudioPositionTotal = 0;
-      AudioQueue.swap(AudioSwapQueue);
-      return;
-    } else {
-      printf("pause!\n");
-      AudioClear();
-      SDL_PauseAudio(1);
-      return;
+  struct Class {
+    size_t entries = 0;
+    uint64_t bytes = 0;
+  };
+  
+  std::filesystem::path path;
+  std::map<std::string, File> files;
+  std::map<std::string, Class> classes;
+  uint64_t open_nanoseconds = 0;
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  uint64_t index_allocations = 0;
+  uint64_t index_blocks = 0;
+  uint64_t index_bytes = 0;
+  
+  uint64_t TotalReads() const { uint64_t n = 0; for (auto& [_, f] : files) n += f.reads; return n; }
+  uint64_t TotalBytes() const { uint64_t n = 0; for (auto& [_, f] : files) n += f.bytes; return n; }
+  uint64_t TotalIONanoseconds() const { uint64_t n = 0; for (auto& [_, f] : files) n += f.nanoseconds; return n; }
+};
+
+/* Stats of the context in hx_ctx */
+static std::shared_ptr<LoadStats> CurrentLoadStats;
+
+static std::string JsonEscape(const std::string& str) {
+  std::string out;
+  for (char c : str) {
+    if (c == '"' || c == '\\') out += '\\';
+    if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+      continue;
     }
+    out += c;
   }
+  return out;
+}
+
+/* Where the last entry of a bank ends */
+static uint64_t BankFileSize(const std::filesystem::path& path) {
+  std::error_code ec;
+  uint64_t size = std::filesystem::file_size(path, ec);
+  return ec ? 0 : size;
+}
+
+/* libhx2 parses every entry inside hx_context_open, so per-class cost is
+ * approximated by the number of entries and the bytes they span in the file. */
+static void CollectClassStats(hx_t *ctx, LoadStats& stats) {
+  std::vector<hx_entry_t*> entries;
+  for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) entries.push_back(hx_context_get_entry(ctx, i));
+  std::sort(entries.begin(), entries.end(), [](hx_entry_t* a, hx_entry_t* b) { return a->file_offset < b->file_offset; });
   
-  SDL_MixAudio(stream, (Uint8*)AudioQueue.front()->data + AudioPosition, len, std::clamp(AudioMixVolume, 0.0f, 1.0f) * SDL_MIX_MAXVOLUME);
-  AudioPosition += len;
-  AudioPositionTotal += len;
+  uint64_t file_size = BankFileSize(stats.path);
   
-  if (AudioPosition >= AudioQueue.front()->size) {
-    AudioSwapQueue.push_back(AudioQueue.front());
-    AudioQueue.pop_front();
-    AudioQueueIndex++;
-    AudioPosition = 0;
+  char name[HX_STRING_MAX_LENGTH];
+  for (size_t i = 0; i < entries.size(); i++) {
+    uint64_t next = (i + 1 < entries.size()) ? entries[i + 1]->file_offset : file_size;
+    hx_class_name(entries[i]->i_class, hx_context_version(ctx), name, HX_STRING_MAX_LENGTH);
+    LoadStats::Class& c = stats.classes[name];
+    c.entries++;
+    if (next > entries[i]->file_offset) c.bytes += next - entries[i]->file_offset;
   }
 }
 
-static int AudioLoad(hx_audio_stream_t *stream) {
-  if (SDL_GetAudioStatus() != SDL_AUDIO_STOPPED) {
-    AudioClear();
-    SDL_CloseAudio();
-  }
+static void LogLoadStats(const LoadStats& stats) {
+  auto ms = [](uint64_t ns) { return std::to_string(ns / 1'000'000.0); };
+  uint64_t io = stats.TotalIONanoseconds();
+  uint64_t parse = stats.open_nanoseconds > io ? stats.open_nanoseconds - io : 0;
   
-  if (!stream->data) {
-    Log.push_back({ LogEntry::Type::Error, "failed to load audio stream: data not loaded!" });
-    return -1;
-  }
+  Log.push_back({ LogEntry::Type::Info, "Load breakdown: " + ms(stats.open_nanoseconds) + " ms total, " + ms(io) + " ms I/O, " + ms(parse) + " ms parsing; " +
+    std::to_string(stats.TotalReads()) + " reads, " + std::to_string(stats.TotalBytes()) + " bytes, " +
+    std::to_string(stats.allocations) + " read buffers (" + std::to_string(stats.allocated_bytes) + " bytes)" });
   
-  AudioQueue.push_back(stream);
-  return 1;
+  if (stats.index_allocations)
+    Log.push_back({ LogEntry::Type::Info, "hxtool indexes: " + std::to_string(stats.index_allocations) + " allocations served from " +
+      std::to_string(stats.index_blocks) + " heap blocks instead of " + std::to_string(stats.index_allocations) + " (" +
+      std::to_string(stats.index_bytes / 1024) + " KiB); libhx2 parse allocations are not pooled" });
+  
+  for (auto& [name, f] : stats.files)
+    Log.push_back({ LogEntry::Type::Info, "  " + std::filesystem::path(name).filename().string() + ": " + std::to_string(f.reads) + " reads, " +
+      std::to_string(f.bytes) + " bytes, " + ms(f.nanoseconds) + " ms" });
+  
+  for (auto& [name, c] : stats.classes)
+    Log.push_back({ LogEntry::Type::Info, "  " + name + ": " + std::to_string(c.entries) + " entries, " + std::to_string(c.bytes) + " bytes" });
 }
 
-static void AudioPlay() {
-  if (SDL_GetAudioStatus() == SDL_AUDIO_PLAYING)
-    AudioClear();
+static void PrintLoadStatsJson(FILE *fp, const LoadStats& stats) {
+  uint64_t io = stats.TotalIONanoseconds();
+  fprintf(fp, "{\n  \"file\": \"%s\",\n", JsonEscape(stats.path.string()).c_str());
+  fprintf(fp, "  \"total_ms\": %.3f,\n  \"io_ms\": %.3f,\n  \"parse_ms\": %.3f,\n", stats.open_nanoseconds / 1e6, io / 1e6,
+    (stats.open_nanoseconds > io ? stats.open_nanoseconds - io : 0) / 1e6);
+  fprintf(fp, "  \"reads\": %llu,\n  \"bytes_read\": %llu,\n", (unsigned long long)stats.TotalReads(), (unsigned long long)stats.TotalBytes());
+  fprintf(fp, "  \"allocations\": %llu,\n  \"allocated_bytes\": %llu,\n", (unsigned long long)stats.allocations, (unsigned long long)stats.allocated_bytes);
+  fprintf(fp, "  \"index_allocations\": %llu,\n  \"index_blocks\": %llu,\n  \"index_bytes\": %llu,\n", (unsigned long long)stats.index_allocations,
+    (unsigned long long)stats.index_blocks, (unsigned long long)stats.index_bytes);
   
-  SDL_AudioSpec audio;
-  SDL_memset(&audio, 0, sizeof(audio));
-  audio.freq = 0;
-  audio.format = AUDIO_S16;
-  audio.channels = 0;
-  audio.samples = 1; /* poll `sample_rate` times/sec */
-  audio.callback = &AudioCallback;
-  audio.userdata = &AudioQueue;
+  fprintf(fp, "  \"files\": [");
+  bool first = true;
+  for (auto& [name, f] : stats.files) {
+    fprintf(fp, "%s\n    { \"name\": \"%s\", \"reads\": %llu, \"bytes\": %llu, \"io_ms\": %.3f }", first ? "" : ",",
+      JsonEscape(name).c_str(), (unsigned long long)f.reads, (unsigned long long)f.bytes, f.nanoseconds / 1e6);
+    first = false;
+  }
   
-  for (auto enqueued : AudioQueue) {
-    /* Decode the stream */
-    hx_audio_stream* pcm = enqueued;
-    if (pcm->info.fmt != HX_FORMAT_PCM) {
-      pcm = (hx_audio_stream*)malloc(sizeof(*pcm));
-      pcm->info.fmt = HX_FORMAT_PCM;
-    }
-    
-    if (hx_audio_convert(enqueued, pcm) < 0) {
-      Log.push_back({ LogEntry::Type::Error, "failed to load audio stream: unsupported codec " + std::string(hx_format_name(enqueued->info.fmt)) });
-      return;
-    }
-//
-//    switch (enqueued->info.codec) {
-//      case HX_FORMAT_PCM: break;
-//      case HX_FORMAT_DSP: dsp_decode(hx_ctx, enqueued, pcm); break;
-//      default:
-//        Log.push_back({ LogEntry::Type::Error, "failed to load audio stream: unsupported codec " + std::string(HX_FORMAT_name(enqueued->info.codec)) });
-//        return;
-//    }
-//
-    audio.channels = pcm->info.num_channels;
-    audio.freq = pcm->info.sample_rate;
-    AudioLength += pcm->size;
-    
-    /* Replace the stream */
-    AudioQueue.pop_front();
-    AudioQueue.push_back(pcm);
+  fprintf(fp, "\n  ],\n  \"classes\": [");
+  first = true;
+  for (auto& [name, c] : stats.classes) {
+    fprintf(fp, "%s\n    { \"name\": \"%s\", \"entries\": %zu, \"bytes\": %llu }", first ? "" : ",",
+      JsonEscape(name).c_str(), c.entries, (unsigned long long)c.bytes);
+    first = false;
   }
+  fprintf(fp, "\n  ]\n}\n");
+}
+
+static bool IsResourceFile(std::filesystem::path p) {
+  return p.extension() == ".hst" || p.extension() == ".HST" ||
+  p.extension() == ".hos" || p.extension() == ".HOS";
+}
+
+/* Files of a context live next to its bank; callbacks without stats use work_directory */
+static std::string ResolvePath(std::filesystem::path p, void* userdata) {
+  if (LoadStats *stats = static_cast<LoadStats*>(userdata)) return (stats->path.parent_path() / p.filename()).string();
+  return work_directory.string() + p.filename().string();
+}
+
+static std::fstream* FindOrCreateFileStream(std::filesystem::path p, void* userdata) {
+  std::string filename = ResolvePath(p, userdata);
+  if (FileMap.find(filename) != FileMap.end()) return FileMap[filename];
+  return FileMap[filename] = new std::fstream(filename, std::ios::binary | std::ios::in | std::ios::out);
+}
+
+#pragma mark - Hashing
+
+/* Fast non-cryptographic 64-bit hash (xxHash64 round structure). Matches are
+ * always confirmed by comparing the bytes where it matters. */
+static uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0) {
+  static constexpr uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full, P3 = 0x165667B19E3779F9ull;
+  auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  uint64_t h = seed + P3 + size;
   
-  AudioSampleRate = audio.freq;
-  AudioChannelCount = audio.channels;
-  AudioPosition = 0;
+  while (size >= 8) {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    h ^= rotl(k * P2, 31) * P1;
+    h = rotl(h, 27) * P1 + P3;
+    p += 8;
+    size -= 8;
+  }
   
-  if (AudioQueue.size() > 0) {
-    if (SDL_OpenAudio(&audio, NULL) < 0) {
-      fprintf(stderr, "failed to open audio: %s\n", SDL_GetError());
-      return;
-    }
-    
-    SDL_PauseAudio(0);
+  while (size > 0) {
+    h ^= (*p++) * P3;
+    h = rotl(h, 11) * P1;
+    size--;
   }
+  
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
 }
 
-static void QueueAudioEntry(hx_entry_t* e) {
-  if (e->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
-    hx_event_resource_data_t *data = (hx_event_resource_data_t*)e->data;
-    hx_entry_t *link = hx_context_find_entry(hx_ctx, data->link);
-    if (link) {
-      if (link->i_class == HX_CLASS_WAVE_RESOURCE_DATA) {
-        hx_wav_resource_data_t *waveres = (hx_wav_resource_data_t*)link->data;
-        link = hx_context_find_entry(hx_ctx, waveres->default_cuuid);
-        if (link) {
-          hx_wave_file_id_object_t *waveobj = (hx_wave_file_id_object_t*)link->data;
-          if (AudioLoad(waveobj->audio_stream)) {
-            PlayingEvent = e;
-            AudioPlay();
-          }
-        }
-      } else if (link->i_class == HX_CLASS_PROGRAM_RESOURCE_DATA) {
-        hx_program_resource_data_t *progres = (hx_program_resource_data_t*)link->data;
+struct EntryDigest {
+  uint64_t cuuid;
+  enum hx_class i_class;
+  uint64_t hash;
+  uint64_t stream;
+  std::string name;
+};
+
+/* Hashes the fields hxtool knows for each class; other classes compare by class only.
+ * With `by_location`, external streams hash where their payload lives instead of its bytes,
+ * so a payload the budget evicted compares equal to a resident one. */
+static EntryDigest DigestEntry(hx_entry_t *e, bool by_location = false) {
+  EntryDigest d = { e->cuuid, e->i_class, 0, 0, "" };
+  uint64_t h = HashBytes(&e->i_class, sizeof(e->i_class));
+  
+  switch (e->i_class) {
+    case HX_CLASS_EVENT_RESOURCE_DATA: {
+      hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(e->data);
+      d.name = data->name;
+      h = HashBytes(data->name, strlen(data->name), h);
+      h = HashBytes(&data->link, sizeof(data->link), h);
+      h = HashBytes(data->c, sizeof(data->c), h);
+      break;
+    }
+    case HX_CLASS_WAVE_RESOURCE_DATA: {
+      hx_wav_resource_data_t *data = static_cast<hx_wav_resource_data_t*>(e->data);
+      h = HashBytes(&data->res_data.flags, sizeof(data->res_data.flags), h);
+      h = HashBytes(data->res_data.c, sizeof(data->res_data.c), h);
+      h = HashBytes(&data->default_cuuid, sizeof(data->default_cuuid), h);
+      for (unsigned int i = 0; i < data->num_links; i++) {
+        h = HashBytes(&data->links[i].cuuid, sizeof(data->links[i].cuuid), h);
+        h = HashBytes(&data->links[i].language, sizeof(data->links[i].language), h);
+      }
+      break;
+    }
+    case HX_CLASS_PROGRAM_RESOURCE_DATA: {
+      hx_program_resource_data_t *data = static_cast<hx_program_resource_data_t*>(e->data);
+      h = HashBytes(data->links, data->num_links * sizeof(*data->links), h);
+      break;
+    }
+    case HX_CLASS_WAVE_FILE_ID_OBJECT: {
+      hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(e->data);
+      h = HashBytes(data->ext_stream_filename, strlen(data->ext_stream_filename), h);
+      h = HashBytes(&data->ext_stream_size, sizeof(data->ext_stream_size), h);
+      if (hx_audio_stream_t *s = data->audio_stream) {
+        d.stream = HashBytes(&s->info.fmt, sizeof(s->info.fmt));
+        d.stream = HashBytes(&s->info.num_channels, sizeof(s->info.num_channels), d.stream);
+        d.stream = HashBytes(&s->info.sample_rate, sizeof(s->info.sample_rate), d.stream);
+        if (by_location && data->ext_stream_size > 0)
+          d.stream = HashBytes(&data->ext_stream_offset, sizeof(data->ext_stream_offset), d.stream);
+        else if (s->data)
+          d.stream = HashBytes(s->data, s->size, d.stream);
+      }
+      h ^= d.stream;
+      break;
+    }
+    default: break;
+  }
+  
+  d.hash = h;
+  return d;
+}
+
+static std::vector<EntryDigest> DigestContext(hx_t *ctx, bool by_location = false) {
+  std::vector<EntryDigest> digests(hx_context_num_entries(ctx));
+  Scheduler->ParallelFor(TaskPriority::Batch, digests.size(), [&](size_t i) {
+    digests[i] = DigestEntry(hx_context_get_entry(ctx, i), by_location);
+  });
+  return digests;
+}
+
+#pragma mark - Buffered writer
+
+/* Collects the writes libhx2 makes to one output file in large aligned
+ * blocks and issues them as vectored pwritev calls, merging ranges that
+ * are adjacent in the file. Nothing reaches the disk until Flush(), unless
+ * the buffered data grows past SpillThreshold. */
+class BufferedWriter {
+public:
+  static constexpr size_t BlockSize = 4 << 20;
+  static constexpr size_t Alignment = 4096;
+  static constexpr size_t SpillThreshold = 256 << 20;
+  
+  BufferedWriter(std::filesystem::path p, bool truncate = true) : path(p) {
+    fd = open(path.string().c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+  }
+  
+  ~BufferedWriter() {
+    Flush();
+    for (char* b : blocks) free(b);
+    if (fd >= 0) close(fd);
+  }
+  
+  bool IsOpen() const { return fd >= 0; }
+  
+  void Write(size_t offset, const void* data, size_t size) {
+    const char* src = static_cast<const char*>(data);
+    while (size > 0) {
+      if (blocks.empty() || used == BlockSize) {
+        blocks.push_back(static_cast<char*>(aligned_alloc(Alignment, BlockSize)));
+        used = 0;
+      }
+      
+      size_t n = std::min(size, BlockSize - used);
+      char* dst = blocks.back() + used;
+      memcpy(dst, src, n);
+      
+      /* Extend the previous chunk when this write continues it both in the file and in memory */
+      Chunk* last = chunks.empty() ? nullptr : &chunks.back();
+      if (last && last->offset + last->size == offset && last->data + last->size == dst) last->size += n;
+      else chunks.push_back({ offset, dst, n });
+      
+      used += n;
+      buffered += n;
+      offset += n;
+      src += n;
+      size -= n;
+    }
+    
+    if (buffered >= SpillThreshold) Flush();
+  }
+  
+  /* Writes everything buffered so far; returns false if any write failed */
+  bool Flush() {
+    if (chunks.empty()) return !failed;
+    
+    /* Writing in file order is only safe when no two chunks overlap */
+    std::vector<Chunk> ordered = chunks;
+    std::stable_sort(ordered.begin(), ordered.end(), [](const Chunk& a, const Chunk& b) { return a.offset < b.offset; });
+    bool overlapping = false;
+    for (size_t i = 1; i < ordered.size(); i++) overlapping |= ordered[i - 1].offset + ordered[i - 1].size > ordered[i].offset;
+    if (overlapping) ordered = chunks;
+    
+    std::vector<iovec> iov;
+    size_t run_offset = 0, run_end = 0;
+    for (const Chunk& c : ordered) {
+      if (iov.size() == IOV_MAX || (!iov.empty() && c.offset != run_end)) {
+        WriteRun(iov, run_offset);
+        iov.clear();
+      }
+      if (iov.empty()) run_offset = c.offset;
+      iov.push_back({ c.data, c.size });
+      run_end = c.offset + c.size;
+    }
+    if (!iov.empty()) WriteRun(iov, run_offset);
+    
+    written += buffered;
+    chunks.clear();
+    buffered = 0;
+    
+    /* Keep one block around for the next writes */
+    for (size_t i = 1; i < blocks.size(); i++) free(blocks[i]);
+    if (!blocks.empty()) blocks.resize(1);
+    used = 0;
+    return !failed;
+  }
+  
+  bool Sync() { return fd >= 0 && Flush() && fsync(fd) == 0; }
+  
+  size_t BytesWritten() const { return written + buffered; }
+  const std::filesystem::path& Path() const { return path; }
+  
+private:
+  struct Chunk {
+    size_t offset;
+    char* data;
+    size_t size;
+  };
+  
+  std::filesystem::path path;
+  int fd = -1;
+  std::vector<char*> blocks;
+  std::vector<Chunk> chunks;
+  size_t used = 0;
+  size_t buffered = 0;
+  size_t written = 0;
+  bool failed = false;
+  
+  void WriteRun(std::vector<iovec> iov, size_t offset) {
+    size_t index = 0;
+    while (index < iov.size()) {
+      ssize_t n = pwritev(fd, iov.data() + index, int(iov.size() - index), offset);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        Log.push_back({ LogEntry::Type::Error, "Failed to write " + path.string() + ": " + strerror(errno) });
+        failed = true;
+        return;
+      }
+      
+      /* Skip what a short write already covered */
+      offset += n;
+      while (index < iov.size() && size_t(n) >= iov[index].iov_len) n -= iov[index++].iov_len;
+      if (index < iov.size()) {
+        iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + n;
+        iov[index].iov_len -= n;
+      }
+    }
+  }
+};
+
+/* Output files of the save in progress, keyed by destination. Each writer
+ * targets a temporary file next to its destination. */
+static std::map<std::string, std::unique_ptr<BufferedWriter>> Writers;
+
+static std::filesystem::path TemporaryPath(const std::filesystem::path& destination) {
+  return destination.string() + ".tmp" + std::to_string(getpid());
+}
+
+static void SyncDirectory(const std::filesystem::path& directory) {
+  int fd = open(directory.empty() ? "." : directory.string().c_str(), O_RDONLY);
+  if (fd < 0) return;
+  fsync(fd);
+  close(fd);
+}
+
+static std::filesystem::path BackupPath(const std::filesystem::path& destination) {
+  return destination.string() + ".bak" + std::to_string(getpid());
+}
+
+/* Finishes the save in progress: every temporary file is flushed and synced,
+ * and only when all of them succeeded are they renamed over their destinations.
+ * A bank and its .hst/.hos resources are committed as one group: the previous
+ * files are hard-linked (or, where links are unsupported, copied) aside first, and
+ * if any rename fails the ones already replaced are restored from those. Passing `commit` = false discards
+ * the temporary files. */
+static bool CommitWriters(bool commit, size_t *total_bytes = nullptr) {
+  std::lock_guard<std::mutex> lock(FileMutex);
+  bool success = commit;
+  size_t total = 0;
+  for (auto& [destination, writer] : Writers) {
+    success &= writer->IsOpen() && writer->Sync();
+    total += writer->BytesWritten();
+  }
+  
+  /* Destinations that existed before, with a copy of their previous contents */
+  std::set<std::string> backed_up;
+  for (auto& [destination, writer] : Writers) {
+    if (!success) break;
+    std::string backup = BackupPath(destination).string();
+    unlink(backup.c_str());
+    if (link(destination.c_str(), backup.c_str()) == 0) {
+      backed_up.insert(destination);
+      continue;
+    }
+    if (errno == ENOENT) continue;
+    
+    /* FAT, exFAT and many network mounts have no hard links */
+    std::error_code ec;
+    if (std::filesystem::copy_file(destination, backup, std::filesystem::copy_options::overwrite_existing, ec)) {
+      backed_up.insert(destination);
+    } else {
+      unlink(backup.c_str());
+      Log.push_back({ LogEntry::Type::Warning, "Could not keep a copy of " + destination + " (" + ec.message() + "); it cannot be restored if the save fails" });
+    }
+  }
+  
+  std::vector<std::string> replaced;
+  for (auto& [destination, writer] : Writers) {
+    if (!success) break;
+    if (rename(writer->Path().string().c_str(), destination.c_str()) != 0) {
+      Log.push_back({ LogEntry::Type::Error, "Failed to replace " + destination + ": " + strerror(errno) });
+      success = false;
+    } else {
+      replaced.push_back(destination);
+    }
+  }
+  
+  /* Roll back what was already replaced so the bank and its resources stay matched */
+  std::vector<std::string> stranded;
+  if (!success) {
+    for (const std::string& destination : replaced) {
+      bool restored = backed_up.count(destination) ? rename(BackupPath(destination).c_str(), destination.c_str()) == 0 : unlink(destination.c_str()) == 0;
+      if (!restored) stranded.push_back(destination);
+    }
+  }
+  
+  std::set<std::filesystem::path> directories;
+  for (auto& [destination, writer] : Writers) {
+    unlink(writer->Path().string().c_str());
+    /* A backup that could not be put back is the only copy of the original */
+    if (std::find(stranded.begin(), stranded.end(), destination) == stranded.end()) unlink(BackupPath(destination).c_str());
+    directories.insert(std::filesystem::path(destination).parent_path());
+    
+    /* Cached read handles still point at the replaced file */
+    auto it = FileMap.find(destination);
+    if (it != FileMap.end()) {
+      delete it->second;
+      FileMap.erase(it);
+    }
+  }
+  
+  for (auto& d : directories) SyncDirectory(d);
+  
+  if (!success && !Writers.empty()) {
+    if (stranded.empty()) {
+      Log.push_back({ LogEntry::Type::Info, "The original files were left untouched" });
+    } else {
+      for (const std::string& destination : stranded)
+        Log.push_back({ LogEntry::Type::Error, "Could not restore " + destination + "; it holds the new contents, the original is kept as " +
+          BackupPath(destination).string() });
+    }
+  }
+  
+  Writers.clear();
+  if (total_bytes) *total_bytes = total;
+  return success;
+}
+
+/* Set while a worker serializes the context; main thread only */
+static bool Saving = false;
+
+/* Set while a save swaps converted streams into the context (see PrepareStreams);
+ * playback, diffs and index builds stay away from the streams until it is cleared */
+static bool StreamsBorrowed = false;
+
+/* Bytes handed to WriteCB by the save in progress, reported in 10% steps */
+static std::atomic<uint64_t> SaveProgress = 0;
+static std::atomic<int> SaveProgressStep = 0;
+static uint64_t SaveProgressTotal = 0;
+
+static void ReportSaveProgress(size_t bytes) {
+  uint64_t done = SaveProgress += bytes;
+  if (SaveProgressTotal == 0) return;
+  int step = int(std::min<uint64_t>(10, done * 10 / SaveProgressTotal));
+  int previous = SaveProgressStep;
+  if (step > previous && SaveProgressStep.compare_exchange_strong(previous, step) && step < 10)
+    Log.push_back({ LogEntry::Type::Info, "Saving... " + std::to_string(step * 10) + "%" });
+}
+
+/* While set, WriteCB keeps the serialized files in memory so the bank can be patched in place */
+static bool CaptureWrites = false;
+static std::map<std::string, std::vector<char>> CapturedWrites;
+
+/* Overwrites only the blocks of `destination` that differ from `image`.
+ * The file must already have the size of the image. */
+static bool PatchFile(const std::string& destination, const std::vector<char>& image, size_t& patched) {
+  static constexpr size_t BlockSize = 64 << 10;
+  
+  int fd = open(destination.c_str(), O_RDWR);
+  if (fd < 0) return false;
+  
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) != image.size()) {
+    close(fd);
+    return false;
+  }
+  
+  const char* old = nullptr;
+  if (!image.empty()) {
+    void* map = mmap(nullptr, image.size(), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    old = static_cast<const char*>(map);
+  }
+  
+  bool success = true;
+  for (size_t offset = 0; offset < image.size() && success; offset += BlockSize) {
+    size_t n = std::min(BlockSize, image.size() - offset);
+    if (memcmp(old + offset, image.data() + offset, n) == 0) continue;
+    for (size_t done = 0; done < n && success;) {
+      ssize_t w = pwrite(fd, image.data() + offset + done, n - done, offset + done);
+      if (w < 0 && errno == EINTR) continue;
+      success = w > 0;
+      if (success) done += w;
+    }
+    patched += n;
+  }
+  
+  if (old) munmap((void*)old, image.size());
+  success &= fsync(fd) == 0;
+  close(fd);
+  return success;
+}
+
+static char* ReadCB(const char* fn, size_t pos, size_t *size, void* userdata) {
+  PROFILE_ZONE("ReadCB");
+  std::filesystem::path path(fn);
+  std::string filename = ResolvePath(path, userdata);
+  
+  std::lock_guard<std::mutex> lock(FileMutex);
+  uint64_t begin = ProfileNow();
+  std::fstream *fs = FindOrCreateFileStream(path, userdata);
+    
+  if (fs->is_open()) {
+    fs->seekg(0, std::ios_base::end);
+    size_t real_size = fs->tellg();
+    if (pos > real_size) pos = real_size;
+    if (*size > real_size - pos) *size = real_size - pos;
+    fs->seekg(pos);
+    
+    char* data = (char*)malloc(*size);
+    fs->read(data, *size);
+    
+    if (LoadStats *stats = static_cast<LoadStats*>(userdata)) {
+      LoadStats::File& f = stats->files[filename];
+      f.reads++;
+      f.bytes += *size;
+      f.nanoseconds += ProfileNow() - begin;
+      stats->allocations++;
+      stats->allocated_bytes += *size;
+    }
+    
+    return data;
+  }
+  
+  return nullptr;
+}
+
+static void WriteCB(const char* filename, void* data, size_t pos, size_t *size, void* userdata) {
+  PROFILE_ZONE("WriteCB");
+  std::filesystem::path path(filename);
+  std::string output = ResolvePath(path, userdata);
+  
+  ReportSaveProgress(*size);
+  
+  std::lock_guard<std::mutex> lock(FileMutex);
+  if (CaptureWrites) {
+    /* Stream payloads are unchanged unless a wave was replaced */
+    if (IsResourceFile(path) && !DirtyStreams) return;
+    std::vector<char>& image = CapturedWrites[output];
+    if (image.size() < pos + *size) image.resize(pos + *size);
+    memcpy(image.data() + pos, data, *size);
+    return;
+  }
+  
+  std::unique_ptr<BufferedWriter>& writer = Writers[output];
+  if (!writer) {
+    writer = std::make_unique<BufferedWriter>(TemporaryPath(output));
+    if (!writer->IsOpen()) Log.push_back({ LogEntry::Type::Error, "Failed to open " + writer->Path().string() + ": " + strerror(errno) });
+  }
+  
+  if (writer->IsOpen()) writer->Write(pos, data, *size);
+}
+
+static void ErrorCB(const char* str, void*) {
+  if (Headless) fprintf(stderr, "warning: %s\n", str);
+  else Log.push_back({ LogEntry::Type::Warning, str });
+}
+
+static std::string ConfigFile() {
+  std::filesystem::path path = BasePath;
+  if (!std::filesystem::exists(path)) std::filesystem::create_directory(path);
+  path += "/hxtool.cfg";
+  return path.string();
+}
+
+static void SaveConfig() {
+  FILE *fp = fopen(ConfigFile().c_str(), "w");
+  fprintf(fp, "ThemeColor = %X\n", ImGui::ColorConvertFloat4ToU32(ColorCoefficients));
+  fprintf(fp, "BorderLess = %d\n", SDL_GetWindowFlags(Window) & SDL_WINDOW_BORDERLESS);
+  fprintf(fp, "IdleRendering = %d\n", IdleRendering);
+  fprintf(fp, "FrameRateCap = %d\n", FrameRateCap);
+  fprintf(fp, "MemoryBudget = %d\n", MemoryBudget);
+  fprintf(fp, "Verify = %d\n", VerifyOnSave);
+  fprintf(fp, "PatchInPlace = %d\n", PatchInPlace);
+  fclose(fp);
+}
+
+static void LoadConfig() {
+  FILE *fp = fopen(ConfigFile().c_str(), "r");
+  if (!fp) return;
+  int color = 0xFFFFFFFF, borderless = 0, idle = IdleRendering, verify = VerifyOnSave, patch = PatchInPlace;
+  fscanf(fp, "ThemeColor = %X\n", &color);
+  fscanf(fp, "BorderLess = %d\n", &borderless);
+  fscanf(fp, "IdleRendering = %d\n", &idle);
+  fscanf(fp, "FrameRateCap = %d\n", &FrameRateCap);
+  fscanf(fp, "MemoryBudget = %d\n", &MemoryBudget);
+  fscanf(fp, "Verify = %d\n", &verify);
+  fscanf(fp, "PatchInPlace = %d\n", &patch);
+  IdleRendering = idle;
+  VerifyOnSave = verify;
+  PatchInPlace = patch;
+  FrameRateCap = std::clamp(FrameRateCap, 0, 240);
+  MemoryBudget = std::max(MemoryBudget, 0);
+  ColorCoefficients = ImGui::ColorConvertU32ToFloat4(color);
+  SDL_SetWindowBordered(Window, SDL_bool(!borderless));
+  fclose(fp);
+}
+
+#pragma mark - Arena
+
+/* Forwards to `upstream` and counts what passes through */
+class CountingResource : public std::pmr::memory_resource {
+public:
+  explicit CountingResource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) : upstream(upstream) {}
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+  
+private:
+  std::pmr::memory_resource *upstream;
+  
+  void* do_allocate(size_t size, size_t alignment) override {
+    allocations++;
+    bytes += size;
+    return upstream->allocate(size, alignment);
+  }
+  
+  void do_deallocate(void* p, size_t size, size_t alignment) override {
+    upstream->deallocate(p, size, alignment);
+  }
+  
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+/* Bump allocator for the indexes hxtool builds per bank. Nothing is freed individually;
+ * the whole region goes back to the heap when the last index of the bank is dropped.
+ * Not thread-safe: indexes are built on one worker and then only touched by the main thread.
+ * 
+ * This does not cover the allocations hx_context_open makes while parsing: libhx2 calls
+ * malloc directly and has no allocator hook, so those still go to the heap one by one. */
+struct BankArena {
+  CountingResource blocks;
+  std::pmr::monotonic_buffer_resource arena{ 64 * 1024, &blocks };
+  CountingResource requests{ &arena };
+  
+  std::pmr::memory_resource* Resource() { return &requests; }
+};
+
+#pragma mark - Search index
+
+/* Trigram index over event names plus a sorted cuuid table for prefix lookups.
+ * Built on the loading worker; owned by the main thread once the bank is swapped in. */
+struct SearchIndex {
+  struct Row {
+    hx_entry_t *entry; /* null while the bank is previewed from its sidecar */
+    hx_size_t index;
+    uint64_t cuuid;
+    std::pmr::string name; /* lowercase */
+  };
+  
+  /* Declared first so it is released after the containers */
+  std::shared_ptr<BankArena> memory;
+  std::pmr::vector<Row> rows;
+  std::pmr::unordered_map<hx_entry_t*, uint32_t> row_of;
+  std::pmr::unordered_map<uint32_t, std::pmr::vector<uint32_t>> trigrams;
+  std::pmr::vector<std::pair<uint64_t, uint32_t>> cuuids;
+  
+  explicit SearchIndex(std::shared_ptr<BankArena> memory) : memory(memory),
+    rows(memory->Resource()), row_of(memory->Resource()), trigrams(memory->Resource()), cuuids(memory->Resource()) {}
+  
+  static uint32_t Trigram(const char* s) {
+    return (uint32_t)(uint8_t)s[0] << 16 | (uint32_t)(uint8_t)s[1] << 8 | (uint8_t)s[2];
+  }
+  
+  static std::string Lower(const char* s) {
+    std::string out(s);
+    for (char& c : out) c = tolower((unsigned char)c);
+    return out;
+  }
+  
+  void Insert(uint32_t row) {
+    const std::pmr::string& name = rows[row].name;
+    for (size_t i = 0; i + 3 <= name.size(); i++) {
+      std::pmr::vector<uint32_t>& list = trigrams[Trigram(&name[i])];
+      auto it = std::lower_bound(list.begin(), list.end(), row);
+      if (it == list.end() || *it != row) list.insert(it, row);
+    }
+  }
+  
+  void Remove(uint32_t row) {
+    const std::pmr::string& name = rows[row].name;
+    for (size_t i = 0; i + 3 <= name.size(); i++) {
+      auto found = trigrams.find(Trigram(&name[i]));
+      if (found == trigrams.end()) continue;
+      auto it = std::lower_bound(found->second.begin(), found->second.end(), row);
+      if (it != found->second.end() && *it == row) found->second.erase(it);
+    }
+  }
+  
+  void Build(hx_t *ctx) {
+    PROFILE_ZONE("SearchIndex::Build");
+    rows.reserve(hx_context_num_entries(ctx));
+    cuuids.reserve(hx_context_num_entries(ctx));
+    for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) {
+      hx_entry_t *e = hx_context_get_entry(ctx, i);
+      if (e->i_class != HX_CLASS_EVENT_RESOURCE_DATA) continue;
+      uint32_t row = rows.size();
+      rows.push_back({ e, i, e->cuuid, std::pmr::string(Lower(static_cast<hx_event_resource_data_t*>(e->data)->name), memory->Resource()) });
+      row_of[e] = row;
+      cuuids.push_back({ e->cuuid, row });
+      Insert(row);
+    }
+    std::sort(cuuids.begin(), cuuids.end());
+  }
+  
+  /* Re-indexes the name of an edited event */
+  bool Update(hx_entry_t *e) {
+    auto it = row_of.find(e);
+    if (it == row_of.end()) return false;
+    std::string name = Lower(static_cast<hx_event_resource_data_t*>(e->data)->name);
+    if (std::string_view(name) == std::string_view(rows[it->second].name)) return false;
+    Remove(it->second);
+    rows[it->second].name = name;
+    Insert(it->second);
+    return true;
+  }
+  
+  /* Parses "0x1A2B" or "1a2b" into the range of cuuids whose hex form starts with it */
+  static bool CuuidRange(std::string q, uint64_t& lo, uint64_t& hi) {
+    if (q.starts_with("0x")) q = q.substr(2);
+    if (q.empty() || q.size() > 16 || q.find_first_not_of("0123456789abcdef") != std::string::npos) return false;
+    unsigned int shift = 4 * (16 - q.size());
+    lo = std::stoull(q, nullptr, 16) << shift;
+    hi = lo | (shift ? (~0ull >> (64 - shift)) : 0);
+    return true;
+  }
+  
+  /* Rows matching `text` in bank order. When `previous` holds the results of a prefix of
+   * `text`, only those are re-checked, which keeps typing incremental. */
+  void Query(const std::string& text, const std::vector<uint32_t>* previous, std::vector<uint32_t>& out) const {
+    std::string q = Lower(text.c_str());
+    out.clear();
+    
+    if (q.empty()) {
+      out.resize(rows.size());
+      for (uint32_t i = 0; i < rows.size(); i++) out[i] = i;
+      return;
+    }
+    
+    uint64_t lo = 0, hi = 0;
+    bool by_cuuid = CuuidRange(q, lo, hi);
+    auto matches = [&](uint32_t row) {
+      if (rows[row].name.find(q) != std::string::npos) return true;
+      return by_cuuid && rows[row].cuuid >= lo && rows[row].cuuid <= hi;
+    };
+    
+    if (previous) {
+      for (uint32_t row : *previous) if (matches(row)) out.push_back(row);
+      return;
+    }
+    
+    if (q.size() < 3) {
+      for (uint32_t row = 0; row < rows.size(); row++) if (matches(row)) out.push_back(row);
+      return;
+    }
+    
+    /* Intersect the posting lists, shortest first, then confirm the substring */
+    std::vector<const std::pmr::vector<uint32_t>*> lists;
+    for (size_t i = 0; i + 3 <= q.size(); i++) {
+      auto it = trigrams.find(Trigram(&q[i]));
+      if (it == trigrams.end()) { lists.clear(); break; }
+      lists.push_back(&it->second);
+    }
+    
+    if (!lists.empty()) {
+      std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+      for (uint32_t row : *lists[0]) {
+        bool all = true;
+        for (size_t i = 1; i < lists.size() && all; i++) all = std::binary_search(lists[i]->begin(), lists[i]->end(), row);
+        if (all && rows[row].name.find(q) != std::string::npos) out.push_back(row);
+      }
+    }
+    
+    if (by_cuuid) {
+      auto it = std::lower_bound(cuuids.begin(), cuuids.end(), std::make_pair(lo, 0u));
+      for (; it != cuuids.end() && it->first <= hi; it++) out.push_back(it->second);
+      std::sort(out.begin(), out.end());
+      out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+  }
+};
+
+static std::shared_ptr<SearchIndex> Search;
+static bool SearchStale = true;
+
+#pragma mark - Memory accounting
+
+/* Where the memory of a loaded bank goes. Built once on the loading worker; after that only
+ * wave file objects change size, and MarkDirty re-counts those one at a time. */
+struct MemoryAccount {
+  struct Class {
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+  };
+  
+  std::map<enum hx_class, Class> classes;
+  uint64_t streams = 0;
+  uint64_t external_streams = 0;
+  uint64_t encoded_bytes = 0;
+  uint64_t external_bytes = 0;
+  std::unordered_map<hx_entry_t*, std::pair<uint64_t, bool>> stream_bytes;
+  
+  /* Structs libhx2 allocates for an entry, as far as hxtool knows their layout;
+   * other classes are estimated from their serialized size */
+  static uint64_t EntryBytes(hx_entry_t *e, uint64_t serialized) {
+    switch (e->i_class) {
+      case HX_CLASS_EVENT_RESOURCE_DATA:
+        return sizeof(hx_entry_t) + sizeof(hx_event_resource_data_t);
+      case HX_CLASS_WAVE_RESOURCE_DATA: {
+        hx_wav_resource_data_t *data = static_cast<hx_wav_resource_data_t*>(e->data);
+        return sizeof(hx_entry_t) + sizeof(*data) + data->num_links * sizeof(*data->links);
+      }
+      case HX_CLASS_PROGRAM_RESOURCE_DATA: {
+        hx_program_resource_data_t *data = static_cast<hx_program_resource_data_t*>(e->data);
+        return sizeof(hx_entry_t) + sizeof(*data) + data->num_links * sizeof(*data->links);
+      }
+      case HX_CLASS_WAVE_FILE_ID_OBJECT:
+        return sizeof(hx_entry_t) + sizeof(hx_wave_file_id_object_t) + sizeof(hx_audio_stream_t);
+      default:
+        return sizeof(hx_entry_t) + serialized;
+    }
+  }
+  
+  void AddStream(hx_entry_t *e, int sign) {
+    auto& [bytes, external] = stream_bytes[e];
+    if (sign < 0) {
+      encoded_bytes -= bytes;
+      if (external) external_bytes -= bytes;
+      if (external) external_streams--;
+      streams--;
+      return;
+    }
+    
+    hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(e->data);
+    bytes = (data->audio_stream && data->audio_stream->data) ? data->audio_stream->size : 0;
+    external = data->ext_stream_size > 0;
+    encoded_bytes += bytes;
+    if (external) external_bytes += bytes;
+    if (external) external_streams++;
+    streams++;
+  }
+  
+  /* Entries are measured up to the next one, the last one up to `file_size` (as in CollectClassStats) */
+  void Build(hx_t *ctx, uint64_t file_size) {
+    PROFILE_ZONE("MemoryAccount::Build");
+    *this = MemoryAccount();
+    
+    std::vector<hx_entry_t*> entries;
+    for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) entries.push_back(hx_context_get_entry(ctx, i));
+    std::sort(entries.begin(), entries.end(), [](hx_entry_t *a, hx_entry_t *b) { return a->file_offset < b->file_offset; });
+    
+    for (size_t i = 0; i < entries.size(); i++) {
+      hx_entry_t *e = entries[i];
+      uint64_t next = (i + 1 < entries.size()) ? entries[i + 1]->file_offset : file_size;
+      Class& c = classes[e->i_class];
+      c.entries++;
+      c.bytes += EntryBytes(e, next > e->file_offset ? next - e->file_offset : 0);
+      if (e->i_class == HX_CLASS_WAVE_FILE_ID_OBJECT) AddStream(e, +1);
+    }
+  }
+  
+  void Update(hx_entry_t *e) {
+    if (!stream_bytes.count(e)) return;
+    AddStream(e, -1);
+    AddStream(e, +1);
+  }
+  
+  uint64_t EntryTotal() const {
+    uint64_t total = 0;
+    for (auto& [_, c] : classes) total += c.bytes;
+    return total;
+  }
+};
+
+static std::shared_ptr<MemoryAccount> Memory;
+
+#pragma mark - Frame pacing
+
+/* ImGui needs a few frames after an input event to settle hover and layout state */
+static int PendingFrames = 3;
+
+static float CPUUsage = 0.0f;
+static std::clock_t CPUSampleClock = 0;
+static Uint32 CPUSampleTicks = 0;
+
+static bool NeedsContinuousRedraw() {
+  if (!IdleRendering) return true;
+  if (SDL_GetAudioStatus() == SDL_AUDIO_PLAYING) return true;
+  if (Scheduler && Scheduler->NumPending() > 0) return true;
+  return false;
+}
+
+static void SampleCPUUsage() {
+  Uint32 ticks = SDL_GetTicks();
+  if (ticks - CPUSampleTicks < 1000) return;
+  std::clock_t clock = std::clock();
+  if (CPUSampleTicks != 0) {
+    float cpu_ms = 1000.0f * float(clock - CPUSampleClock) / CLOCKS_PER_SEC;
+    CPUUsage = 100.0f * cpu_ms / float(ticks - CPUSampleTicks);
+  }
+  CPUSampleClock = clock;
+  CPUSampleTicks = ticks;
+}
+
+static void LimitFrameRate(Uint64 frame_begin) {
+  if (FrameRateCap <= 0) return;
+  double elapsed = double(SDL_GetPerformanceCounter() - frame_begin) / SDL_GetPerformanceFrequency();
+  double remaining = 1.0 / FrameRateCap - elapsed;
+  if (remaining > 0.0) SDL_Delay(Uint32(remaining * 1000.0));
+}
+
+#pragma mark - Memory budget
+
+/* Last-use clock shared by everything the budget can evict */
+static uint64_t MemoryTick = 0;
+
+/* Workers digesting stream payloads; payloads stay resident while any are running */
+static int StreamReaders = 0;
+
+/* Decoded PCM kept across plays, keyed by wave file cuuid. The cache owns its streams;
+ * their structs are recycled through a free list. Main thread only. */
+struct PCMCache {
+  struct Item {
+    hx_audio_stream_t *stream;
+    uint64_t used;
+  };
+  
+  std::unordered_map<uint64_t, Item> items;
+  std::vector<hx_audio_stream_t*> free_streams;
+  size_t bytes = 0;
+  size_t capacity = 256 * 1024 * 1024;
+  
+  uint64_t hits = 0, misses = 0;
+  uint64_t structs_reused = 0, structs_allocated = 0;
+  
+  hx_audio_stream_t* Find(uint64_t key) {
+    auto it = items.find(key);
+    if (it == items.end()) {
+      misses++;
+      return nullptr;
+    }
+    it->second.used = ++MemoryTick;
+    hits++;
+    return it->second.stream;
+  }
+  
+  hx_audio_stream_t* Acquire() {
+    hx_audio_stream_t *s;
+    if (!free_streams.empty()) {
+      s = free_streams.back();
+      free_streams.pop_back();
+      structs_reused++;
+    } else {
+      s = (hx_audio_stream_t*)malloc(sizeof(*s));
+      structs_allocated++;
+    }
+    memset(s, 0, sizeof(*s));
+    return s;
+  }
+  
+  void Release(hx_audio_stream_t *s) {
+    hx_audio_stream_dealloc(s);
+    free_streams.push_back(s);
+  }
+  
+  void Insert(uint64_t key, hx_audio_stream_t *s) {
+    items[key] = { s, ++MemoryTick };
+    bytes += s->size;
+  }
+  
+  void Erase(uint64_t key) {
+    auto it = items.find(key);
+    if (it == items.end()) return;
+    bytes -= it->second.stream->size;
+    Release(it->second.stream);
+    items.erase(it);
+  }
+  
+  void Clear() {
+    for (auto& [_, item] : items) Release(item.stream);
+    items.clear();
+    bytes = 0;
+  }
+};
+
+static PCMCache AudioCache;
+
+/* Encoded payloads of the active bank's external streams. libhx2 reads them at open; under a
+ * budget they are dropped and read back through ReadCB the next time they are needed. Main
+ * thread only, except for the streams handed to a worker by BeginReload. */
+struct PayloadRegistry {
+  struct Payload {
+    hx_entry_t *entry;
+    uint64_t used;
+    bool loading = false;
+    uint64_t hash = 0; /* of the evicted bytes, 0 when the file is expected to have changed */
+  };
+  
+  struct Reload {
+    hx_audio_stream_t *stream;
+    hx_entry_t *entry;
+    uint64_t hash;
+  };
+  
+  std::unordered_map<hx_audio_stream_t*, Payload> payloads;
+  uint64_t evictions = 0, reloads = 0;
+  bool reloading = false;
+  
+  /* `hashes` are those of a previous Hashes() of the same context */
+  void Build(hx_t *ctx, const std::unordered_map<hx_audio_stream_t*, uint64_t>& hashes = {}) {
+    payloads.clear();
+    for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) {
+      hx_entry_t *e = hx_context_get_entry(ctx, i);
+      if (e->i_class != HX_CLASS_WAVE_FILE_ID_OBJECT) continue;
+      hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(e->data);
+      if (!data->audio_stream || data->ext_stream_size == 0) continue;
+      auto hash = hashes.find(data->audio_stream);
+      payloads[data->audio_stream] = { e, 0, false, hash != hashes.end() ? hash->second : 0 };
+    }
+  }
+  
+  /* Of the payloads currently evicted, for when the context is registered again */
+  std::unordered_map<hx_audio_stream_t*, uint64_t> Hashes() const {
+    std::unordered_map<hx_audio_stream_t*, uint64_t> hashes;
+    for (auto& [s, p] : payloads) if (!s->data && p.hash) hashes[s] = p.hash;
+    return hashes;
+  }
+  
+  /* Edited payloads exist only in memory until the next save. Only a payload libhx2 kept as
+   * the exact bytes of its range in the resource file can be read back from there. */
+  bool Evictable(hx_audio_stream_t *s, const Payload& p) const {
+    hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(p.entry->data);
+    return !p.loading && s->data && s->size == data->ext_stream_size && !DirtyEntries.count(p.entry);
+  }
+  
+  /* `verify` = false when the resource file changed and the new bytes are wanted */
+  void Evict(hx_audio_stream_t *s, bool verify = true) {
+    payloads[s].hash = verify ? HashBytes(s->data, s->size) : 0;
+    hx_audio_stream_t keep = *s;
+    hx_audio_stream_dealloc(s);
+    *s = keep;
+    s->data = nullptr;
+    s->size = 0;
+    evictions++;
+    if (Memory) Memory->Update(payloads[s].entry);
+  }
+  
+  /* Makes sure the payload of `s` is in memory */
+  bool Ensure(hx_audio_stream_t *s) {
+    auto it = payloads.find(s);
+    if (it == payloads.end()) return s->data != nullptr;
+    if (it->second.loading) return false;
+    it->second.used = ++MemoryTick;
+    if (s->data) return true;
+    
+    hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(it->second.entry->data);
+    char *payload = Read(data, it->second.hash, CurrentLoadStats.get());
+    if (!payload) return false;
+    
+    s->data = (short*)payload;
+    s->size = data->ext_stream_size;
+    reloads++;
+    if (Memory) Memory->Update(it->second.entry);
+    return true;
+  }
+  
+  /* Before anything reads every stream of the bank (save, diff, verify): hands the evicted
+   * payloads to the worker, which reads them back with Load. */
+  std::vector<Reload> BeginReload() {
+    std::vector<Reload> pending;
+    for (auto& [s, p] : payloads) {
+      if (s->data) continue;
+      p.loading = true;
+      pending.push_back({ s, p.entry, p.hash });
+    }
+    reloading = !pending.empty();
+    return pending;
+  }
+  
+  /* Reads a payload back from its resource file. A short read, or bytes other than the
+   * ones evicted, fail the reload instead of silently replacing the audio. */
+  static char* Read(hx_wave_file_id_object_t *data, uint64_t hash, LoadStats *stats) {
+    size_t size = data->ext_stream_size;
+    char *payload = ReadCB(data->ext_stream_filename, data->ext_stream_offset, &size, stats);
+    std::string problem;
+    if (!payload) problem = "cannot be opened";
+    else if (size != data->ext_stream_size) problem = "ends before the stream does";
+    else if (hash && HashBytes(payload, size) != hash) problem = "no longer holds the evicted stream";
+    if (problem.empty()) return payload;
+    
+    free(payload);
+    Log.push_back({ LogEntry::Type::Error, "Failed to reload stream: " + std::string(data->ext_stream_filename) + " " + problem });
+    return nullptr;
+  }
+  
+  /* Worker side of BeginReload */
+  static bool Load(const std::vector<Reload>& pending, LoadStats *stats) {
+    bool success = true;
+    for (const Reload& r : pending) {
+      hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(r.entry->data);
+      char *payload = Read(data, r.hash, stats);
+      if (!payload) {
+        success = false;
+        continue;
+      }
+      r.stream->data = (short*)payload;
+      r.stream->size = data->ext_stream_size;
+    }
+    return success;
+  }
+  
+  /* Back on the main thread once Load returned */
+  void FinishReload(const std::vector<Reload>& pending) {
+    for (const Reload& r : pending) {
+      auto it = payloads.find(r.stream);
+      if (it == payloads.end()) continue;
+      it->second.loading = false;
+      it->second.used = ++MemoryTick;
+      if (r.stream->data) reloads++;
+      if (Memory) Memory->Update(r.entry);
+    }
+    reloading = false;
+  }
+};
+
+static PayloadRegistry Payloads;
+
+/* Evicts decoded and encoded audio, least recently used first, until the bank's audio fits
+ * MemoryBudget. Without a budget only the PCM cache is held to its capacity. `pinned` holds
+ * the streams the audio callback may still read. */
+static void EnforceMemoryBudget(const std::set<const void*>& pinned) {
+  uint64_t budget = MemoryBudget > 0 ? MemoryBudget * 1024ull * 1024ull : 0;
+  uint64_t usage = AudioCache.bytes + ((budget && Memory) ? Memory->encoded_bytes : 0);
+  uint64_t limit = budget ? budget : AudioCache.capacity;
+  if (usage <= limit) return;
+  PROFILE_ZONE("EnforceMemoryBudget");
+  
+  struct Candidate {
+    uint64_t used;
+    uint64_t bytes;
+    uint64_t key;
+    hx_audio_stream_t *payload;
+  };
+  
+  std::vector<Candidate> candidates;
+  for (auto& [key, item] : AudioCache.items)
+    if (!pinned.count(item.stream)) candidates.push_back({ item.used, item.stream->size, key, nullptr });
+  
+  /* Save and diff workers read the payloads directly */
+  if (budget && !Saving && StreamReaders == 0) {
+    for (auto& [s, p] : Payloads.payloads)
+      if (Payloads.Evictable(s, p) && !pinned.count(s)) candidates.push_back({ p.used, s->size, 0, s });
+  }
+  
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.used < b.used; });
+  
+  size_t decoded = 0, encoded = 0;
+  uint64_t freed = 0;
+  for (const Candidate& c : candidates) {
+    if (usage <= limit) break;
+    if (c.payload) {
+      Payloads.Evict(c.payload);
+      encoded++;
+    } else {
+      AudioCache.Erase(c.key);
+      decoded++;
+    }
+    usage -= std::min(usage, c.bytes);
+    freed += c.bytes;
+  }
+  
+  if (budget && (decoded || encoded)) {
+    Log.push_back({ LogEntry::Type::Info, "Memory budget: evicted " + std::to_string(decoded) + " decoded and " + std::to_string(encoded) +
+      " encoded streams (" + std::to_string(freed / 1024 / 1024) + " MiB)" });
+  }
+}
+
+#pragma mark - Audio player
+
+static int AudioLength = 0;
+static int AudioPosition = 0;
+static int AudioPositionTotal = 0;
+static int AudioQueueIndex = 0;
+static bool AudioRepeat = false;
+static float AudioMixVolume = 0.5f;
+
+static int AudioSampleRate = 0;
+static int AudioChannelCount = 0;
+
+static std::deque<hx_audio_stream*> AudioQueue;
+static std::deque<hx_audio_stream*> AudioSwapQueue;
+
+/* Streams in the queues belong to the bank or to AudioCache */
+static void AudioClear() {
+  AudioLength = 0;
+  AudioPositionTotal = 0;
+  AudioQueueIndex = 0;
+  AudioQueue.clear();
+  AudioSwapQueue.clear();
+}
+
+/* Streams the audio callback may still read */
+static std::set<const void*> PlayingStreams() {
+  SDL_LockAudio();
+  std::set<const void*> streams(AudioQueue.begin(), AudioQueue.end());
+  streams.insert(AudioSwapQueue.begin(), AudioSwapQueue.end());
+  SDL_UnlockAudio();
+  return streams;
+}
+
+static void AudioCallback(void*, Uint8 *stream, int len) {
+  PROFILE_ZONE("AudioCallback");
+  SDL_memset(stream, 0, len);
+  
+  unsigned int AudioRemaining = AudioLength - AudioPositionTotal;
+  len = (len > AudioRemaining ? AudioRemaining : len);
+  
+  if (len == 0) {
+    if (AudioRepeat) {
+      printf("repeat!\n");
+      AudioQueueIndex = 0;
+      AudioPosition = 0;
+      AudioPositionTotal = 0;
+      AudioQueue.swap(AudioSwapQueue);
+      return;
+    } else {
+      printf("pause!\n");
+      AudioClear();
+      SDL_PauseAudio(1);
+      return;
+    }
+  }
+  
+  SDL_MixAudio(stream, (Uint8*)AudioQueue.front()->data + AudioPosition, len, std::clamp(AudioMixVolume, 0.0f, 1.0f) * SDL_MIX_MAXVOLUME);
+  AudioPosition += len;
+  AudioPositionTotal += len;
+  
+  if (AudioPosition >= AudioQueue.front()->size) {
+    AudioSwapQueue.push_back(AudioQueue.front());
+    AudioQueue.pop_front();
+    AudioQueueIndex++;
+    AudioPosition = 0;
+  }
+}
+
+/* Streams without a wave file are keyed by address */
+static uint64_t AudioCacheKey(hx_audio_stream_t *s) {
+  return s->wavefile_cuuid ? (uint64_t)s->wavefile_cuuid : (uint64_t)(uintptr_t)s;
+}
+
+static int AudioLoad(hx_audio_stream_t *stream) {
+  if (StreamsBorrowed) return 0;
+  if (SDL_GetAudioStatus() != SDL_AUDIO_STOPPED) {
+    AudioClear();
+    SDL_CloseAudio();
+  }
+  
+  /* An evicted payload is only needed again when its decoded copy is gone too */
+  bool cached = stream->info.fmt != HX_FORMAT_PCM && AudioCache.items.count(AudioCacheKey(stream));
+  if (!cached && !Payloads.Ensure(stream)) return -1;
+  
+  if (!cached && !stream->data) {
+    Log.push_back({ LogEntry::Type::Error, "failed to load audio stream: data not loaded!" });
+    return -1;
+  }
+  
+  AudioQueue.push_back(stream);
+  return 1;
+}
+
+static void AudioPlay() {
+  if (SDL_GetAudioStatus() == SDL_AUDIO_PLAYING)
+    AudioClear();
+  
+  SDL_AudioSpec audio;
+  SDL_memset(&audio, 0, sizeof(audio));
+  audio.freq = 0;
+  audio.format = AUDIO_S16;
+  audio.channels = 0;
+  audio.samples = 1; /* poll `sample_rate` times/sec */
+  audio.callback = &AudioCallback;
+  audio.userdata = &AudioQueue;
+  
+  /* Decode what the cache does not hold yet, each stream once, in parallel */
+  std::vector<hx_audio_stream*> enqueued(AudioQueue.begin(), AudioQueue.end());
+  std::vector<hx_audio_stream*> decoded(enqueued.size(), nullptr);
+  std::vector<size_t> misses;
+  std::unordered_map<uint64_t, size_t> pending;
+  
+  for (size_t i = 0; i < enqueued.size(); i++) {
+    if (enqueued[i]->info.fmt == HX_FORMAT_PCM) {
+      decoded[i] = enqueued[i];
+      continue;
+    }
+    
+    uint64_t k = AudioCacheKey(enqueued[i]);
+    if (auto it = pending.find(k); it != pending.end()) {
+      decoded[i] = decoded[it->second];
+    } else if (hx_audio_stream *pcm = AudioCache.Find(k)) {
+      decoded[i] = pcm;
+    } else {
+      decoded[i] = AudioCache.Acquire();
+      decoded[i]->info.fmt = HX_FORMAT_PCM;
+      pending[k] = i;
+      misses.push_back(i);
+    }
+  }
+  
+  std::vector<int> results(misses.size(), 0);
+  Scheduler->ParallelFor(TaskPriority::Interactive, misses.size(), [&](size_t m) {
+    PROFILE_ZONE("hx_audio_convert");
+    results[m] = hx_audio_convert(enqueued[misses[m]], decoded[misses[m]]);
+  });
+  
+  bool failed = false;
+  for (size_t m = 0; m < misses.size(); m++) {
+    if (results[m] < 0 && !failed) {
+      Log.push_back({ LogEntry::Type::Error, "failed to load audio stream: unsupported codec " + std::string(hx_format_name(enqueued[misses[m]]->info.fmt)) });
+      failed = true;
+    }
+  }
+  
+  if (failed) {
+    for (size_t i : misses) AudioCache.Release(decoded[i]);
+    return;
+  }
+  
+  for (size_t i : misses) AudioCache.Insert(AudioCacheKey(enqueued[i]), decoded[i]);
+  
+  /* Replace the streams */
+  AudioQueue.clear();
+  for (hx_audio_stream* pcm : decoded) {
+    audio.channels = pcm->info.num_channels;
+    audio.freq = pcm->info.sample_rate;
+    AudioLength += pcm->size;
+    AudioQueue.push_back(pcm);
+  }
+  
+  AudioSampleRate = audio.freq;
+  AudioChannelCount = audio.channels;
+  AudioPosition = 0;
+  EnforceMemoryBudget(PlayingStreams());
+  
+  if (AudioQueue.size() > 0) {
+    if (SDL_OpenAudio(&audio, NULL) < 0) {
+      fprintf(stderr, "failed to open audio: %s\n", SDL_GetError());
+      return;
+    }
+    
+    SDL_PauseAudio(0);
+  }
+}
+
+/* Forward references of an entry, in the order EntryTableTree walks them */
+static void CollectLinks(hx_entry_t *e, std::vector<uint64_t>& out) {
+  switch (e->i_class) {
+    case HX_CLASS_EVENT_RESOURCE_DATA: {
+      out.push_back(static_cast<hx_event_resource_data_t*>(e->data)->link);
+      break;
+    }
+    case HX_CLASS_WAVE_RESOURCE_DATA: {
+      hx_wav_resource_data_t *data = static_cast<hx_wav_resource_data_t*>(e->data);
+      if (data->default_cuuid) out.push_back(data->default_cuuid);
+      for (unsigned int i = 0; i < data->num_links; i++) out.push_back(data->links[i].cuuid);
+      break;
+    }
+    case HX_CLASS_PROGRAM_RESOURCE_DATA: {
+      hx_program_resource_data_t *data = static_cast<hx_program_resource_data_t*>(e->data);
+      for (unsigned int i = 0; i < data->num_links; i++) out.push_back(data->links[i]);
+      break;
+    }
+    default: break;
+  }
+}
+
+/* Reverse edges of CollectLinks: for every cuuid, the entries that link to it.
+ * Built on the loading worker and kept current by MarkDirty. */
+struct ReferenceIndex {
+  std::shared_ptr<BankArena> memory;
+  std::pmr::unordered_map<uint64_t, std::pmr::vector<hx_entry_t*>> users;
+  std::pmr::unordered_map<hx_entry_t*, std::pmr::vector<uint64_t>> links;
+  uint64_t version = 0; /* bumped on every change, for callers caching derived results */
+  
+  explicit ReferenceIndex(std::shared_ptr<BankArena> memory) : memory(memory), users(memory->Resource()), links(memory->Resource()) {}
+  
+  void Add(hx_entry_t *e) {
+    version++;
+    std::vector<uint64_t> out;
+    CollectLinks(e, out);
+    links[e].assign(out.begin(), out.end());
+    for (uint64_t cuuid : out) users[cuuid].push_back(e);
+  }
+  
+  void Build(hx_t *ctx) {
+    PROFILE_ZONE("ReferenceIndex::Build");
+    users.reserve(hx_context_num_entries(ctx));
+    links.reserve(hx_context_num_entries(ctx));
+    for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) Add(hx_context_get_entry(ctx, i));
+  }
+  
+  void Update(hx_entry_t *e) {
+    auto it = links.find(e);
+    if (it != links.end()) {
+      for (uint64_t cuuid : it->second) {
+        std::pmr::vector<hx_entry_t*>& list = users[cuuid];
+        list.erase(std::remove(list.begin(), list.end(), e), list.end());
+      }
+      it->second.clear();
+    }
+    Add(e);
+  }
+  
+  const std::pmr::vector<hx_entry_t*>& UsedBy(uint64_t cuuid) const {
+    static const std::pmr::vector<hx_entry_t*> none;
+    auto it = users.find(cuuid);
+    return it == users.end() ? none : it->second;
+  }
+  
+  /* Events that reach `cuuid` through any chain of links */
+  std::vector<hx_entry_t*> Events(uint64_t cuuid) const {
+    std::vector<hx_entry_t*> events;
+    std::set<uint64_t> visited = { cuuid };
+    std::vector<uint64_t> pending = { cuuid };
+    while (!pending.empty()) {
+      uint64_t next = pending.back();
+      pending.pop_back();
+      for (hx_entry_t *user : UsedBy(next)) {
+        if (!visited.insert(user->cuuid).second) continue;
+        if (user->i_class == HX_CLASS_EVENT_RESOURCE_DATA) events.push_back(user);
+        pending.push_back(user->cuuid);
+      }
+    }
+    return events;
+  }
+};
+
+static std::shared_ptr<ReferenceIndex> References;
+
+#pragma mark - Sidecar cache
+
+/* What hxtool knows about a bank without parsing it: its events, the links between entries
+ * and where the streams live. Stored next to the config, one file per bank, and mapped
+ * read-only when the bank is opened again unchanged. */
+struct SidecarHeader {
+  char magic[8];
+  uint64_t file_size;
+  int64_t mtime;
+  uint64_t header_hash;
+  uint32_t num_events;
+  uint32_t num_edges;
+  uint32_t num_streams;
+  uint32_t path_offset;
+  uint64_t strings_size;
+};
+
+struct SidecarEvent {
+  uint64_t cuuid;
+  uint32_t index;
+  uint32_t name_offset;
+};
+
+struct SidecarEdge {
+  uint64_t from;
+  uint64_t to;
+};
+
+struct SidecarStream {
+  uint64_t cuuid;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t filename_offset; /* 0 for streams inside the bank */
+  uint32_t reserved;
+};
+
+static constexpr char SidecarMagic[8] = { 'H', 'X', 'I', 'D', 'X', '0', '0', '1' };
+
+struct Sidecar {
+  void* map = MAP_FAILED;
+  size_t size = 0;
+  const SidecarHeader *header = nullptr;
+  const SidecarEvent *events = nullptr;
+  const SidecarEdge *edges = nullptr;     /* sorted by `from` */
+  const SidecarStream *streams = nullptr; /* sorted by `cuuid` */
+  const char* strings = nullptr;
+  
+  ~Sidecar() {
+    if (map != MAP_FAILED) munmap(map, size);
+  }
+  
+  const char* String(uint32_t offset) const {
+    return strings + offset;
+  }
+  
+  std::pair<const SidecarEdge*, const SidecarEdge*> Links(uint64_t cuuid) const {
+    return std::equal_range(edges, edges + header->num_edges, SidecarEdge{ cuuid, 0 },
+      [](const SidecarEdge& a, const SidecarEdge& b) { return a.from < b.from; });
+  }
+  
+  const SidecarStream* Stream(uint64_t cuuid) const {
+    const SidecarStream *end = streams + header->num_streams;
+    const SidecarStream *it = std::lower_bound(streams, end, cuuid, [](const SidecarStream& s, uint64_t c) { return s.cuuid < c; });
+    return (it != end && it->cuuid == cuuid) ? it : nullptr;
+  }
+};
+
+struct SidecarKey {
+  uint64_t file_size = 0;
+  int64_t mtime = 0;
+  uint64_t header_hash = 0;
+  
+  bool operator==(const SidecarKey&) const = default;
+};
+
+static std::filesystem::path SidecarPath(const std::filesystem::path& bank) {
+  if (!BasePath) return {};
+  std::string absolute = std::filesystem::absolute(bank).string();
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.hxidx", (unsigned long long)HashBytes(absolute.data(), absolute.size()));
+  return std::filesystem::path(BasePath) / "cache" / name;
+}
+
+/* Size, modification time and a hash of the first 4 KiB identify an unchanged bank */
+static bool ReadSidecarKey(const std::filesystem::path& bank, SidecarKey& key) {
+  struct stat st;
+  if (stat(bank.c_str(), &st) != 0) return false;
+  
+  char head[4096];
+  int fd = open(bank.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  ssize_t n = pread(fd, head, sizeof(head), 0);
+  close(fd);
+  if (n < 0) return false;
+  
+  key.file_size = st.st_size;
+  key.mtime = (int64_t)std::filesystem::last_write_time(bank).time_since_epoch().count();
+  key.header_hash = HashBytes(head, n);
+  return true;
+}
+
+static std::shared_ptr<Sidecar> LoadSidecar(const std::filesystem::path& bank) {
+  PROFILE_ZONE("LoadSidecar");
+  SidecarKey key;
+  std::filesystem::path path = SidecarPath(bank);
+  if (path.empty() || !ReadSidecarKey(bank, key)) return nullptr;
+  
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  std::shared_ptr<Sidecar> sidecar = std::make_shared<Sidecar>();
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SidecarHeader)) {
+    sidecar->size = st.st_size;
+    sidecar->map = mmap(nullptr, sidecar->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (sidecar->map == MAP_FAILED) return nullptr;
+  
+  const char* base = static_cast<const char*>(sidecar->map);
+  const SidecarHeader *h = reinterpret_cast<const SidecarHeader*>(base);
+  if (memcmp(h->magic, SidecarMagic, sizeof(SidecarMagic)) != 0 || h->strings_size > sidecar->size) return nullptr;
+  size_t expected = sizeof(*h) + h->num_events * sizeof(SidecarEvent) + h->num_edges * sizeof(SidecarEdge) +
+    h->num_streams * sizeof(SidecarStream) + h->strings_size;
+  if (expected != sidecar->size) return nullptr;
+  if (h->file_size != key.file_size || h->mtime != key.mtime || h->header_hash != key.header_hash) return nullptr;
+  
+  sidecar->header = h;
+  sidecar->events = reinterpret_cast<const SidecarEvent*>(base + sizeof(*h));
+  sidecar->edges = reinterpret_cast<const SidecarEdge*>(sidecar->events + h->num_events);
+  sidecar->streams = reinterpret_cast<const SidecarStream*>(sidecar->edges + h->num_edges);
+  sidecar->strings = reinterpret_cast<const char*>(sidecar->streams + h->num_streams);
+  
+  /* The file may be stale, truncated by a crash or written by another build: every offset
+   * must land in the string table, and lookups binary search the edges and streams */
+  if (h->strings_size == 0 || sidecar->strings[h->strings_size - 1] != '\0') return nullptr;
+  if (h->path_offset >= h->strings_size) return nullptr;
+  for (uint32_t i = 0; i < h->num_events; i++)
+    if (sidecar->events[i].name_offset >= h->strings_size) return nullptr;
+  for (uint32_t i = 0; i < h->num_streams; i++)
+    if (sidecar->streams[i].filename_offset >= h->strings_size) return nullptr;
+  if (!std::is_sorted(sidecar->edges, sidecar->edges + h->num_edges, [](const SidecarEdge& a, const SidecarEdge& b) { return a.from < b.from; }) ||
+      !std::is_sorted(sidecar->streams, sidecar->streams + h->num_streams, [](const SidecarStream& a, const SidecarStream& b) { return a.cuuid < b.cuuid; }))
+    return nullptr;
+  
+  if (std::filesystem::absolute(bank).string() != sidecar->String(h->path_offset)) return nullptr;
+  return sidecar;
+}
+
+/* Written after a full parse, through a temporary file so readers never see half of it */
+static void WriteSidecar(const std::filesystem::path& bank, hx_t *ctx) {
+  PROFILE_ZONE("WriteSidecar");
+  SidecarKey key;
+  std::filesystem::path path = SidecarPath(bank);
+  if (path.empty() || !ReadSidecarKey(bank, key)) return;
+  
+  std::vector<SidecarEvent> events;
+  std::vector<SidecarEdge> edges;
+  std::vector<SidecarStream> streams;
+  std::string strings(1, '\0');
+  auto intern = [&](const char* s) {
+    uint32_t offset = strings.size();
+    strings.append(s);
+    strings.push_back('\0');
+    return offset;
+  };
+  
+  uint32_t path_offset = intern(std::filesystem::absolute(bank).string().c_str());
+  std::vector<uint64_t> links;
+  for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) {
+    hx_entry_t *e = hx_context_get_entry(ctx, i);
+    if (e->i_class == HX_CLASS_EVENT_RESOURCE_DATA)
+      events.push_back({ e->cuuid, (uint32_t)i, intern(static_cast<hx_event_resource_data_t*>(e->data)->name) });
+    
+    if (e->i_class == HX_CLASS_WAVE_FILE_ID_OBJECT) {
+      hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(e->data);
+      if (data->ext_stream_size > 0) streams.push_back({ e->cuuid, data->ext_stream_offset, data->ext_stream_size, intern(data->ext_stream_filename), 0 });
+      else if (data->audio_stream) streams.push_back({ e->cuuid, e->file_offset, data->audio_stream->size, 0, 0 });
+    }
+    
+    links.clear();
+    CollectLinks(e, links);
+    for (uint64_t to : links) edges.push_back({ e->cuuid, to });
+  }
+  
+  std::stable_sort(edges.begin(), edges.end(), [](const SidecarEdge& a, const SidecarEdge& b) { return a.from < b.from; });
+  std::sort(streams.begin(), streams.end(), [](const SidecarStream& a, const SidecarStream& b) { return a.cuuid < b.cuuid; });
+  
+  SidecarHeader h = {};
+  memcpy(h.magic, SidecarMagic, sizeof(SidecarMagic));
+  h.file_size = key.file_size;
+  h.mtime = key.mtime;
+  h.header_hash = key.header_hash;
+  h.num_events = events.size();
+  h.num_edges = edges.size();
+  h.num_streams = streams.size();
+  h.path_offset = path_offset;
+  h.strings_size = strings.size();
+  
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  std::filesystem::path temporary = TemporaryPath(path);
+  std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.write(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(SidecarEvent));
+  out.write(reinterpret_cast<const char*>(edges.data()), edges.size() * sizeof(SidecarEdge));
+  out.write(reinterpret_cast<const char*>(streams.data()), streams.size() * sizeof(SidecarStream));
+  out.write(strings.data(), strings.size());
+  out.close();
+  
+  if (!out || rename(temporary.c_str(), path.c_str()) != 0) std::filesystem::remove(temporary, ec);
+}
+
+/* Event rows straight from the sidecar, so the list can be searched before the bank is parsed */
+static std::shared_ptr<SearchIndex> PreviewIndex(const Sidecar& sidecar) {
+  PROFILE_ZONE("PreviewIndex");
+  std::shared_ptr<SearchIndex> search = std::make_shared<SearchIndex>(std::make_shared<BankArena>());
+  search->rows.reserve(sidecar.header->num_events);
+  search->cuuids.reserve(sidecar.header->num_events);
+  for (uint32_t i = 0; i < sidecar.header->num_events; i++) {
+    const SidecarEvent& event = sidecar.events[i];
+    search->rows.push_back({ nullptr, event.index, event.cuuid,
+      std::pmr::string(SearchIndex::Lower(sidecar.String(event.name_offset)), search->memory->Resource()) });
+    search->cuuids.push_back({ event.cuuid, i });
+    search->Insert(i);
+  }
+  std::sort(search->cuuids.begin(), search->cuuids.end());
+  return search;
+}
+
+#pragma mark - Workspace
+
+/* One opened bank. The active bank's context and indexes are also published through
+ * hx_ctx, Search, References and Memory, which the rest of the UI works on. */
+struct Bank {
+  std::filesystem::path path;
+  hx_t *ctx = nullptr;
+  std::shared_ptr<LoadStats> stats;
+  std::shared_ptr<SearchIndex> search;
+  std::shared_ptr<ReferenceIndex> references;
+  std::shared_ptr<MemoryAccount> memory;
+  bool dirty_streams = false;
+  std::unordered_map<hx_audio_stream_t*, uint64_t> evicted; /* PayloadRegistry::Hashes() while inactive */
+  std::vector<uint32_t> results; /* rows of `search` matching the Events filter */
+  
+  /* Set while the bank is shown from its sidecar and still being parsed; `ctx` is null */
+  std::shared_ptr<Sidecar> sidecar;
+};
+
+/* Sorted by path */
+static std::vector<std::shared_ptr<Bank>> Workspace;
+static Bank* ActiveBank = nullptr;
+
+/* Where each cuuid of the workspace is defined, for links that cross banks */
+struct CuuidIndex {
+  struct Definition {
+    Bank *bank;
+    hx_entry_t *entry;
+    uint64_t hash;
+  };
+  
+  std::unordered_map<uint64_t, std::vector<Definition>> definitions;
+  std::vector<uint64_t> shared;    /* defined identically in several banks */
+  std::vector<uint64_t> conflicts; /* defined differently in several banks */
+  
+  /* Digests every bank (each in parallel), then merges on the calling thread */
+  void Build(const std::vector<std::shared_ptr<Bank>>& banks) {
+    PROFILE_ZONE("CuuidIndex::Build");
+    std::vector<std::vector<EntryDigest>> digests;
+    size_t total = 0;
+    for (auto& bank : banks) {
+      digests.push_back(DigestContext(bank->ctx, true)); /* only the active bank's payloads can be reloaded */
+      total += digests.back().size();
+    }
+    
+    definitions.reserve(total);
+    for (size_t b = 0; b < banks.size(); b++) {
+      for (size_t i = 0; i < digests[b].size(); i++)
+        definitions[digests[b][i].cuuid].push_back({ banks[b].get(), hx_context_get_entry(banks[b]->ctx, i), digests[b][i].hash });
+    }
+    
+    for (auto& [cuuid, defs] : definitions) {
+      if (defs.size() < 2) continue;
+      bool same = std::all_of(defs.begin(), defs.end(), [&](const Definition& d) { return d.hash == defs.front().hash; });
+      (same ? shared : conflicts).push_back(cuuid);
+    }
+    std::sort(shared.begin(), shared.end());
+    std::sort(conflicts.begin(), conflicts.end());
+  }
+  
+  const std::vector<Definition>* Find(uint64_t cuuid) const {
+    auto it = definitions.find(cuuid);
+    return it == definitions.end() ? nullptr : &it->second;
+  }
+  
+  /* The first definition outside `bank` */
+  const Definition* FindOutside(uint64_t cuuid, const Bank *bank) const {
+    if (auto defs = Find(cuuid)) for (const Definition& d : *defs) if (d.bank != bank) return &d;
+    return nullptr;
+  }
+};
+
+static std::shared_ptr<CuuidIndex> GlobalIndex;
+
+/* Banks of the latest LoadHXFile call whose results have not reached the main thread yet */
+static size_t LoadsPending = 0;
+
+/* The LoadHXFile call the workspace came from */
+static uint64_t WorkspaceGeneration = 0;
+
+/* Set from the moment a bank that changed on disk is parsed again until it is merged */
+static bool Reloading = false;
+
+static void UpdateWindowTitle() {
+  std::string title = "hxtool - " + current_file.string();
+  if (Workspace.size() > 1) title += " (" + std::to_string(Workspace.size()) + " banks)";
+  SDL_SetWindowTitle(Window, title.c_str());
+}
+
+static bool ActiveBankDirty() {
+  if (DirtyStreams) return true;
+  for (hx_entry_t *e : DirtyEntries) if (hx_context_find_entry(hx_ctx, e->cuuid) == e) return true;
+  return false;
+}
+
+/* Object Window edits of every bank live in DirtyEntries; replaced streams of the inactive
+ * banks are remembered per bank */
+static bool BankDirty(const Bank *bank) {
+  if (bank == ActiveBank) return ActiveBankDirty();
+  if (bank->dirty_streams) return true;
+  for (hx_entry_t *e : DirtyEntries) if (hx_context_find_entry(bank->ctx, e->cuuid) == e) return true;
+  return false;
+}
+
+static bool UnsavedChanges() {
+  if (!DirtyEntries.empty() || DirtyStreams) return true;
+  for (auto& bank : Workspace) if (bank.get() != ActiveBank && bank->dirty_streams) return true;
+  return false;
+}
+
+static void ActivateBank(Bank *bank) {
+  if (bank == ActiveBank || !bank->ctx) return;
+  if (Saving) {
+    Log.push_back({ LogEntry::Type::Warning, "Wait for the save to finish before switching banks" });
+    return;
+  }
+  /* A running diff reports against the active bank, and its workers read its payloads */
+  if (StreamReaders > 0) {
+    Log.push_back({ LogEntry::Type::Warning, "Wait for the comparison or index build to finish before switching banks" });
+    return;
+  }
+  
+  SDL_CloseAudio();
+  AudioClear();
+  AudioCache.Clear(); /* keyed by cuuid, which is only unique within a bank */
+  PlayingEvent = nullptr;
+  SelectedObject = nullptr;
+  if (ActiveBank) {
+    ActiveBank->dirty_streams = DirtyStreams;
+    ActiveBank->evicted = Payloads.Hashes();
+  }
+  
+  ActiveBank = bank;
+  hx_ctx = bank->ctx;
+  work_directory = bank->path.parent_path() / "";
+  current_file = bank->path.filename();
+  CurrentLoadStats = bank->stats;
+  Search = bank->search;
+  References = bank->references;
+  Memory = bank->memory;
+  DirtyStreams = bank->dirty_streams;
+  Payloads.Build(hx_ctx, bank->evicted);
+  bank->evicted.clear();
+  EnforceMemoryBudget(PlayingStreams());
+  
+  SelectedEvent = hx_context_get_entry(hx_ctx, 0);
+  SelectedEntryIndex = 0;
+  UpdateWindowTitle();
+}
+
+static void CloseWorkspace() {
+  SDL_CloseAudio();
+  AudioClear();
+  AudioCache.Clear();
+  Payloads.payloads.clear();
+  PlayingEvent = nullptr;
+  SelectedObject = nullptr;
+  SelectedEvent = nullptr;
+  
+  hx_ctx = nullptr;
+  ActiveBank = nullptr;
+  CurrentLoadStats = nullptr;
+  Search = nullptr;
+  References = nullptr;
+  Memory = nullptr;
+  DirtyEntries.clear();
+  DirtyStreams = false;
+  /* Keyed by entries of the contexts freed below */
+  DeferredEventEdits.clear();
+  DeferredWaveEdits.clear();
+  
+  GlobalIndex = nullptr;
+  for (auto& bank : Workspace) if (bank->ctx) hx_context_free(&bank->ctx);
+  Workspace.clear();
+}
+
+/* Activates the bank of `entry` and selects it */
+static void JumpTo(Bank *bank, hx_entry_t *entry) {
+  ActivateBank(bank);
+  if (bank != ActiveBank) return;
+  SelectedObject = entry;
+  if (entry->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
+    SelectedEvent = entry;
+    auto row = Search->row_of.find(entry);
+    if (row != Search->row_of.end()) SelectedEntryIndex = Search->rows[row->second].index;
+  }
+}
+
+static void QueueAudioEntry(hx_entry_t* e) {
+  if (e->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
+    hx_event_resource_data_t *data = (hx_event_resource_data_t*)e->data;
+    hx_entry_t *link = hx_context_find_entry(hx_ctx, data->link);
+    if (link) {
+      if (link->i_class == HX_CLASS_WAVE_RESOURCE_DATA) {
+        hx_wav_resource_data_t *waveres = (hx_wav_resource_data_t*)link->data;
+        link = hx_context_find_entry(hx_ctx, waveres->default_cuuid);
+        if (link) {
+          hx_wave_file_id_object_t *waveobj = (hx_wave_file_id_object_t*)link->data;
+          if (AudioLoad(waveobj->audio_stream) > 0) {
+            PlayingEvent = e;
+            AudioPlay();
+          }
+        }
+      } else if (link->i_class == HX_CLASS_PROGRAM_RESOURCE_DATA) {
+        hx_program_resource_data_t *progres = (hx_program_resource_data_t*)link->data;
         if (progres->num_links > 0) {
           bool success = false;
           for (int i = 0; i < progres->num_links; i++) {
@@ -294,7 +2392,7 @@ static void QueueAudioEntry(hx_entry_t* e) {
               link = hx_context_find_entry(hx_ctx, waveres->default_cuuid);
               if (link) {
                 hx_wave_file_id_object_t *waveobj = (hx_wave_file_id_object_t*)link->data;
-                success |= AudioLoad(waveobj->audio_stream);
+                success |= AudioLoad(waveobj->audio_stream) > 0;
               }
             }
           }
@@ -309,544 +2407,1607 @@ static void QueueAudioEntry(hx_entry_t* e) {
   }
 }
 
-static ImColor Color(float r, float g, float b, float a) {
-  return ImColor(r * ColorCoefficients.x, g * ColorCoefficients.y, b * ColorCoefficients.z, a);
+static ImColor Color(float r, float g, float b, float a) {
+  return ImColor(r * ColorCoefficients.x, g * ColorCoefficients.y, b * ColorCoefficients.z, a);
+}
+
+static void Style() {
+  ImGui::StyleColorsDark();
+  ImGuiStyle& style = ImGui::GetStyle();
+  style.AntiAliasedFill = true;
+  style.FrameRounding = 5.0f;
+  style.WindowPadding = ImVec2(4,4);
+  
+  
+  style.Colors[ImGuiCol_Text] = Color(0.9f, 0.7f, 1.0f, 1.0f);
+  style.Colors[ImGuiCol_TextDisabled] = Color(0.9f, 0.66f, 1.0f, 0.5f);
+  style.Colors[ImGuiCol_Separator] = Color(0.9f, 0.6f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_Button] = Color(0.9f, 0.6f, 1.0f, 0.25f);
+  style.Colors[ImGuiCol_ButtonHovered] = Color(0.9f, 0.6f, 1.0f, 0.4f);
+  style.Colors[ImGuiCol_ButtonActive] = Color(0.9f, 0.6f, 1.0f, 0.6f);
+  
+  style.Colors[ImGuiCol_TitleBg] = Color(0.1f, 0.1f, 0.1f, 1.0f);
+  style.Colors[ImGuiCol_TitleBgActive] = Color(0.15f, 0.15f, 0.15f, 1.0f);
+  style.Colors[ImGuiCol_Border] = Color(0.7f, 0.5f, 1.0f, 0.125f);
+  style.Colors[ImGuiCol_Tab] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TabDimmed] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TabDimmedSelected] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TabHovered] = Color(1.0f, 1.0f, 1.0f, 0.25f);
+  style.Colors[ImGuiCol_TabActive] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TabSelected] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TabSelectedOverline] = Color(1.0f, 1.0f, 1.0f, 0.0f);
+  style.Colors[ImGuiCol_TabDimmedSelectedOverline] = Color(1.0f, 1.0f, 1.0f, 0.0f);
+  style.Colors[ImGuiCol_TabUnfocused] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TextSelectedBg] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  
+  style.Colors[ImGuiCol_Header] = Color(0.6f, 0.5f, 1.0f, 0.25f);
+  style.Colors[ImGuiCol_HeaderHovered] = Color(0.6f, 0.4f, 1.0f, 0.25f);
+  style.Colors[ImGuiCol_HeaderActive] = Color(0.6f, 0.4f, 1.0f, 0.5f);
+  
+  style.Colors[ImGuiCol_MenuBarBg] = Color(0.15f, 0.1f, 0.2f, 1.0f);
+  style.Colors[ImGuiCol_WindowBg] = Color(0.05f*1.3, 0.025f*1.3, 0.075f*1.3, 1.0f);
+  
+  style.Colors[ImGuiCol_SliderGrab] = Color(0.6f, 0.4f, 0.75f, 1.0f);
+  style.Colors[ImGuiCol_SliderGrabActive] = Color(0.75f, 0.55f, 0.9f, 1.0f);
+  
+  style.Colors[ImGuiCol_FrameBg] = Color(0.15f, 0.1f, 0.2f, 0.75f);
+  style.Colors[ImGuiCol_FrameBgHovered] = Color(0.6f, 0.4f, 0.75f, 0.5f);
+  style.Colors[ImGuiCol_FrameBgActive] = Color(0.6f, 0.4f, 0.75f, 0.75);
+  
+  style.Colors[ImGuiCol_TableHeaderBg] = Color(0.8f, 0.5f, 1.0f, 0.25f);
+  style.Colors[ImGuiCol_TableBorderLight] = Color(1.0f, 0.8f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TableBorderStrong] = Color(1.0f, 0.8f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TableRowBg] = Color(1.0f, 0.8f, 1.0f, 0.1f);
+  style.Colors[ImGuiCol_TableRowBgAlt] = Color(1.0f, 0.8f, 1.0f, 0.2f);
+  
+  style.Colors[ImGuiCol_PopupBg] = Color(0.10f, 0.05f, 0.15f, 1.0f);
+  style.Colors[ImGuiCol_ModalWindowDimBg] = Color(0.0f, 0.0f, 0.0f, 0.5f);
+  
+  style.Colors[ImGuiCol_CheckMark] = Color(0.0f, 1.0f, 0.5f, 0.75f);
+}
+
+static void Layout(ImGuiID dockspaceId) {
+  ImGui::DockBuilderRemoveNode(dockspaceId);
+  ImGui::DockBuilderAddNode(dockspaceId, ImGuiDockNodeFlags_DockSpace | ImGuiDockNodeFlags_NoDockingOverCentralNode);
+  ImGui::DockBuilderSetNodeSize(dockspaceId, ImGui::GetMainViewport()->WorkSize);
+  
+  ImGuiID dock_main_id = dockspaceId;
+  ImGuiID left3 = ImGui::DockBuilderSplitNode(dock_main_id, ImGuiDir_Left, 0.25f, nullptr, &dock_main_id);
+  ImGuiID middle1 = dock_main_id;
+  ImGuiID middle2 = ImGui::DockBuilderSplitNode(dock_main_id, ImGuiDir_Down, 0.45f, nullptr, &middle1);
+  ImGuiID middle3 = ImGui::DockBuilderSplitNode(middle2, ImGuiDir_Down, 0.66f, nullptr, &middle2);
+  ImGuiID right1 = ImGui::DockBuilderSplitNode(middle1, ImGuiDir_Right, 0.33f, nullptr, &middle1);
+  
+  ImGui::DockBuilderDockWindow("Events", left3);
+  ImGui::DockBuilderDockWindow("Info", middle1);
+  ImGui::DockBuilderDockWindow("Audio Player", middle2);
+  ImGui::DockBuilderDockWindow("Log Window", middle3);
+  ImGui::DockBuilderDockWindow("Object Window", right1);
+  
+  ImGui::DockBuilderFinish(dockspaceId);
+  Style();
+}
+
+static ImVec4 EntryColor(hx_entry_t *e) {
+  switch (e->i_class) {
+    case HX_CLASS_EVENT_RESOURCE_DATA: {
+      hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(e->data);
+      float y = 2.2f * (uint8_t(data->name[6] *-2) / 255.0f);
+      float w = 6.2f * (uint8_t(data->name[7] *-1) / 255.0f);
+      return ImVec4(0.6f*y, 0.5f, 1.0f*w, 1.0f);
+    }
+      
+    case HX_CLASS_WAVE_RESOURCE_DATA: {
+      return ImVec4(1.0f, 0.7f, 0.1f, 0.5f);
+    }
+      
+    case HX_CLASS_WAVE_FILE_ID_OBJECT: {
+      return ImVec4(1.0f, 0.7f, 0.1f, 0.9f);
+    }
+      
+    default: return ImVec4(1.0f, 1.0f, 1.0f, 0.6f);
+  }
+}
+
+static bool DrawPlayButton(int id, bool paused = false, bool s = true) {
+  ImVec2 size = s ? ImVec2(15,15) : ImVec2(ImGui::GetFrameHeight(), ImGui::GetFrameHeight());
+  ImVec4 text = paused ? ImVec4(1.0f, 0.75f, 0.25f, 0.75f) : ImVec4(0.25f, 1.0f, 0.43f, 0.75f);
+  ImVec4 background = ImVec4(text.x, text.y, text.z, 0.15f);
+  ImGui::PushStyleColor(ImGuiCol_Text, paused ? ImVec4(0,0,0,0) : text);
+  ImGui::PushStyleColor(ImGuiCol_Button, background);
+  ImGui::PushStyleVar(ImGuiStyleVar_FrameRounding, 5.0f);
+  
+  ImVec2 cursor = ImGui::GetCursorScreenPos();
+  s = ImGui::ArrowButtonEx(std::to_string(id).c_str(), ImGuiDir_Right, size);
+  
+  if (paused) {
+    ImDrawList *drawlist = ImGui::GetWindowDrawList();
+    ImVec2 p0 = cursor;
+    p0.x += size.x / 4.0f+1;
+    p0.y += size.y / 4.0f;
+    ImVec2 p1 = ImVec2(p0.x, p0.y + size.y/2.0f);
+
+    drawlist->AddLine(p0, p1, ImGui::GetColorU32(text), 2);
+    p0.x = cursor.x + size.x - size.x / 3.0-1;
+    p1.x = cursor.x + size.x - size.x / 3.0-1;
+    drawlist->AddLine(p0, p1, ImGui::GetColorU32(text), 2);
+  }
+  
+  ImGui::PopStyleColor(2);
+  ImGui::PopStyleVar();
+  return s;
+}
+
+static void DrawAudioPlayer() {
+  PROFILE_ZONE("DrawAudioPlayer");
+  ImGui::Begin("Audio Player", NULL, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+  
+  ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1.0f, 0.75f, 1.0f, 0.025f));
+  ImGui::PushStyleVar(ImGuiStyleVar_ChildRounding, 5.0f);
+  ImGui::BeginChild("AudioPlayerGroup", ImVec2(ImGui::GetContentRegionAvail().x / 1.5f, 0.0f), ImGuiChildFlags_Border);
+    if (PlayingEvent) {
+      ImGui::Text("%s", PlayingEvent ? ((hx_event_resource_data*)PlayingEvent->data)->name : "");
+      ImGui::SameLine();
+      ImGui::TextDisabled("B:%d/%d Q:%d/%d\n", AudioPositionTotal, AudioLength, AudioQueueIndex+1, AudioQueue.size()+AudioSwapQueue.size());
+      
+      
+      ImGui::SameLine();
+      ImVec2 p = ImGui::GetCursorPos();
+      ImGui::SetCursorPosX(ImGui::GetCursorPosX() + 10);
+      ImGui::SetCursorPosY(ImGui::GetCursorPosY() + ImGui::GetTextLineHeightWithSpacing() / 2.0f - 1);
+      
+      ImDrawList *drawlist =  ImGui::GetWindowDrawList();
+      drawlist->AddCircle(ImGui::GetCursorScreenPos(), 5.0f, ImColor(1.0f, 0.5f, 0.2f, 0.25f));
+      if (AudioQueue.size()>0) drawlist->PathArcTo(ImGui::GetCursorScreenPos(), 5.0f, -M_PI_2, float(AudioPosition) / float(AudioQueue.front()->size) * M_PI * 2 - M_PI_2);
+      drawlist->PathStroke(ImColor(1.0f,0.8f,0.3f,1.0f), 0, 2.0f);
+      
+      ImGui::SetCursorPos(p);
+      ImGui::NewLine();
+      
+      
+      unsigned int bytes_per_sec = AudioChannelCount * AudioSampleRate * 2;
+      float sec = float(AudioLength - AudioPositionTotal) / bytes_per_sec;
+      int min = int(sec / 60.0f) % 60;
+      
+      char buf[HX_STRING_MAX_LENGTH];
+      snprintf(buf, HX_STRING_MAX_LENGTH, "%02d:%02d:%06.3f", 0, min, fmod(sec, 60.0f));
+      ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0,2));
+      ImGui::PushStyleVar(ImGuiStyleVar_GrabRounding, 5.0f);
+      ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.85f, 1.0f, 1.0f));
+      ImGui::SetNextItemWidth(-1.0f);
+      ImGui::SliderInt("##Duration", &AudioPositionTotal, 0, AudioLength, buf, ImGuiSliderFlags_ReadOnly | ImGuiSliderFlags_NoInput);
+      ImGui::PopStyleColor();
+      ImGui::PopStyleVar(2);
+      
+      SDL_AudioStatus status = SDL_GetAudioStatus();
+      if (DrawPlayButton(0, status != SDL_AUDIO_PAUSED, false)) {
+        if (AudioQueue.size() > 0) {
+          SDL_PauseAudio(status != SDL_AUDIO_PAUSED);
+        } else {
+          /* Enqueue the last played event */
+          QueueAudioEntry(PlayingEvent);
+        }
+      }
+      
+      ImGui::SameLine();
+    } else {
+      ImGui::TextDisabled("The audio queue is empty.");
+    }
+  
+  ImGui::Checkbox("Repeat", &AudioRepeat);
+  ImGui::SameLine();
+  ImGui::PushStyleVar(ImGuiStyleVar_GrabRounding, 5.0f);
+  ImGui::SetNextItemWidth(100.0f);
+  ImGui::SliderFloat("Volume", &AudioMixVolume, 0.0f, 1.0f);
+  ImGui::PopStyleVar();
+  ImGui::SameLine();
+  ImGui::EndChild();
+  
+  ImGui::SameLine();
+  ImGui::BeginChild("AudioQueueGroup", ImVec2(0,0), ImGuiChildFlags_Border);
+  SDL_LockAudio();
+  for (auto e : AudioQueue) (e==AudioQueue.front()?ImGui::Text:ImGui::TextDisabled)("%016llX\n", e->wavefile_cuuid);
+  SDL_UnlockAudio();
+  ImGui::EndChild();
+  
+  
+  
+  ImGui::PopStyleVar();
+  ImGui::PopStyleColor();
+    
+  ImGui::End();
+}
+
+/* A link that does not resolve in the active bank; clicking it jumps to its definition elsewhere */
+static void ExternalLinkRow(uint64_t cuuid, int depth, std::string info) {
+  const CuuidIndex::Definition *d = GlobalIndex ? GlobalIndex->FindOutside(cuuid, ActiveBank) : nullptr;
+  char out[HX_STRING_MAX_LENGTH];
+  snprintf(out, HX_STRING_MAX_LENGTH, "%016llX", (unsigned long long)cuuid);
+  
+  ImGui::TableNextColumn();
+  ImGui::SetCursorPosX(ImGui::GetCursorPosX() + depth * 10);
+  ImGui::PushID(depth);
+  ImGui::PushStyleColor(ImGuiCol_Text, d ? ImVec4(0.5f, 0.7f, 1.0f, 1.0f) : ImVec4(1.0f, 0.3f, 0.4f, 1.0f));
+  if (ImGui::Selectable(out, false, ImGuiSelectableFlags_SpanAllColumns) && d) JumpTo(d->bank, d->entry);
+  ImGui::PopStyleColor();
+  ImGui::PopID();
+  
+  ImGui::TableNextColumn();
+  ImGui::TextDisabled("%s", info.c_str());
+  
+  ImGui::TableNextColumn();
+  if (d) ImGui::TextDisabled("in %s", d->bank->path.filename().c_str());
+  else ImGui::TextDisabled("missing");
+}
+
+static void EntryTableTree(hx_entry_t* root, int depth, std::string info = "--") {
+  if (!root) return;
+ 
+  ImGui::TableNextColumn();
+  
+  char out[HX_STRING_MAX_LENGTH];
+  
+  if (root->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
+    hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(root->data);
+    snprintf(out, HX_STRING_MAX_LENGTH, "%s\n", data->name);
+  } else {
+    snprintf(out, HX_STRING_MAX_LENGTH, "%016llX\n", root->cuuid);
+  }
+    
+  
+  
+  ImGui::SetCursorPosX(ImGui::GetCursorPosX() + depth * 10);
+  
+  ImGuiTableFlags flags = ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_SpanAllColumns;
+  
+  std::vector<hx_entry_t*> next;
+  std::vector<uint64_t> next_cuuids;
+  std::vector<std::string> info_v;
+  
+  ImGui::PushStyleColor(ImGuiCol_Text, EntryColor(root));
+  if (ImGui::TreeNodeEx(out, flags)) {
+    
+    if (root->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
+      hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(root->data);
+      next.push_back(hx_context_find_entry(hx_ctx, data->link));
+      next_cuuids.push_back(data->link);
+    }
+    
+    if (root->i_class == HX_CLASS_WAVE_RESOURCE_DATA) {
+      hx_wav_resource_data_t *data = static_cast<hx_wav_resource_data_t*>(root->data);
+      if (data->default_cuuid) {
+        next.push_back(hx_context_find_entry(hx_ctx, data->default_cuuid));
+        next_cuuids.push_back(data->default_cuuid);
+      }
+      for (unsigned int i = 0; i < data->num_links; i++) {
+        next.push_back(hx_context_find_entry(hx_ctx, data->links[i].cuuid));
+        next_cuuids.push_back(data->links[i].cuuid);
+        switch(HX_BYTESWAP32(data->links[i].language)) {
+          case HX_LANGUAGE_DE: info_v.push_back("DE"); break;
+          case HX_LANGUAGE_EN: info_v.push_back("EN"); break;
+          case HX_LANGUAGE_ES: info_v.push_back("ES"); break;
+          case HX_LANGUAGE_FR: info_v.push_back("FR"); break;
+          case HX_LANGUAGE_IT: info_v.push_back("IT"); break;
+          default: break;
+        }
+      }
+    }
+    
+    if (root->i_class == HX_CLASS_PROGRAM_RESOURCE_DATA) {
+      hx_program_resource_data_t *data = static_cast<hx_program_resource_data_t*>(root->data);
+      for (unsigned int i = 0; i < data->num_links; i++) {
+        next.push_back(hx_context_find_entry(hx_ctx, data->links[i]));
+        next_cuuids.push_back(data->links[i]);
+      }
+    }
+    
+    ImGui::TreePop();
+  }
+  
+  if (ImGui::IsItemClicked()) {
+    SelectedObject = root;
+  }
+  
+  ImGui::PopStyleColor();
+  
+  ImGui::TableNextColumn();
+  ImGui::TextDisabled(info.c_str());
+  
+  ImGui::TableNextColumn();
+  hx_class_name(root->i_class, hx_context_version(hx_ctx), out, HX_STRING_MAX_LENGTH);
+  
+  ImGui::TextDisabled(out);
+  
+  for (unsigned int i = 0; i < next.size(); i++) {
+    hx_entry_t *e = next.at(i);
+    ImGui::TableNextRow();
+    if (!e && Workspace.size() > 1) ExternalLinkRow(next_cuuids[i], depth + 1, info_v.size() > 0 ? info_v[i] : "--");
+    else EntryTableTree(e, depth + 1, info_v.size() > 0 ? info_v[i] : "--");
+  }
+}
+
+static void DrawInfo() {
+  PROFILE_ZONE("DrawInfo");
+  ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0,0));
+  ImGui::Begin("Info", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+  if (SelectedEvent) {
+    const ImGuiTableFlags flags =
+    ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_NoBordersInBody;
+
+    if (ImGui::BeginTable("Entries", 3, flags)) {
+      ImGui::TableSetupColumn("Name/uuid", ImGuiTableColumnFlags_WidthStretch);
+      ImGui::TableSetupColumn("Info", ImGuiTableColumnFlags_WidthFixed, 50);
+      ImGui::TableSetupColumn("Class", ImGuiTableColumnFlags_WidthFixed, 120);
+      ImGui::TableHeadersRow();
+      EntryTableTree(SelectedEvent, 0);
+      ImGui::EndTable();
+    }
+  }
+  
+  ImGui::End();
+  ImGui::PopStyleVar();
+}
+
+static void MarkDirty(hx_entry_t *e, bool stream = false) {
+  if (!e) return;
+  DirtyEntries.insert(e);
+  DirtyStreams |= stream;
+  if (Search && e->i_class == HX_CLASS_EVENT_RESOURCE_DATA && Search->Update(e)) SearchStale = true;
+  if (References) References->Update(e);
+  if (e->i_class == HX_CLASS_WAVE_FILE_ID_OBJECT) {
+    auto cached = AudioCache.items.find(e->cuuid);
+    if (cached != AudioCache.items.end()) {
+      /* The callback may be mixing from the decoded copy; closing the device waits for it */
+      if (PlayingStreams().count(cached->second.stream)) {
+        SDL_CloseAudio();
+        AudioClear();
+        PlayingEvent = nullptr;
+      }
+      AudioCache.Erase(e->cuuid);
+    }
+  }
+  if (Memory) Memory->Update(e);
+}
+
+/* A save, verify, diff, index build or reload is reading the entries on a worker */
+static bool ContextBusy() {
+  return Saving || StreamReaders > 0;
 }
 
-static void Style() {
-  ImGui::StyleColorsDark();
-  ImGuiStyle& style = ImGui::GetStyle();
-  style.AntiAliasedFill = true;
-  style.FrameRounding = 5.0f;
-  style.WindowPadding = ImVec2(4,4);
+/* Returns the data the Object Window should edit: the entry itself, or a copy of it while
+ * the context is busy */
+template <typename T> static T* DeferredEdit(hx_entry_t *e, std::map<hx_entry_t*, T>& edits) {
+  if (!ContextBusy() && !edits.count(e)) return static_cast<T*>(e->data);
+  return &edits.try_emplace(e, *static_cast<T*>(e->data)).first->second;
+}
+
+/* Called every main loop iteration; does nothing until the workers are done */
+static void ApplyDeferredEdits() {
+  if (ContextBusy()) return;
+  for (auto& [e, copy] : DeferredEventEdits) {
+    if (memcmp(e->data, &copy, sizeof(copy)) == 0) continue;
+    *static_cast<hx_event_resource_data_t*>(e->data) = copy;
+    MarkDirty(e);
+  }
   
+  for (auto& [e, copy] : DeferredWaveEdits) {
+    if (memcmp(e->data, &copy, sizeof(copy)) == 0) continue;
+    *static_cast<hx_wav_resource_data_t*>(e->data) = copy;
+    MarkDirty(e);
+  }
   
-  style.Colors[ImGuiCol_Text] = Color(0.9f, 0.7f, 1.0f, 1.0f);
-  style.Colors[ImGuiCol_TextDisabled] = Color(0.9f, 0.66f, 1.0f, 0.5f);
-  style.Colors[ImGuiCol_Separator] = Color(0.9f, 0.6f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_Button] = Color(0.9f, 0.6f, 1.0f, 0.25f);
-  style.Colors[ImGuiCol_ButtonHovered] = Color(0.9f, 0.6f, 1.0f, 0.4f);
-  style.Colors[ImGuiCol_ButtonActive] = Color(0.9f, 0.6f, 1.0f, 0.6f);
+  DeferredEventEdits.clear();
+  DeferredWaveEdits.clear();
+}
+
+static int ReplaceWaveFile(hx_wave_file_id_object_t *data, std::filesystem::path file) {
+  /* The stream is re-encoded in place, under any worker reading it */
+  if (ContextBusy()) {
+    Log.push_back({ LogEntry::Type::Warning, "Wait for the save, comparison or reload to finish before replacing streams" });
+    return -1;
+  }
   
-  style.Colors[ImGuiCol_TitleBg] = Color(0.1f, 0.1f, 0.1f, 1.0f);
-  style.Colors[ImGuiCol_TitleBgActive] = Color(0.15f, 0.15f, 0.15f, 1.0f);
-  style.Colors[ImGuiCol_Border] = Color(0.7f, 0.5f, 1.0f, 0.125f);
-  style.Colors[ImGuiCol_Tab] = Color(1.0f, 1.0f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TabDimmed] = Color(1.0f, 1.0f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TabDimmedSelected] = Color(1.0f, 1.0f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TabHovered] = Color(1.0f, 1.0f, 1.0f, 0.25f);
-  style.Colors[ImGuiCol_TabActive] = Color(1.0f, 1.0f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TabSelected] = Color(1.0f, 1.0f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TabSelectedOverline] = Color(1.0f, 1.0f, 1.0f, 0.0f);
-  style.Colors[ImGuiCol_TabDimmedSelectedOverline] = Color(1.0f, 1.0f, 1.0f, 0.0f);
-  style.Colors[ImGuiCol_TabUnfocused] = Color(1.0f, 1.0f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TextSelectedBg] = Color(1.0f, 1.0f, 1.0f, 0.1f);
+  if (file.extension() != ".wav") return -1;
   
-  style.Colors[ImGuiCol_Header] = Color(0.6f, 0.5f, 1.0f, 0.25f);
-  style.Colors[ImGuiCol_HeaderHovered] = Color(0.6f, 0.4f, 1.0f, 0.25f);
-  style.Colors[ImGuiCol_HeaderActive] = Color(0.6f, 0.4f, 1.0f, 0.5f);
+  Uint8* buf = nullptr;
+  Uint32 sz = 0;
   
-  style.Colors[ImGuiCol_MenuBarBg] = Color(0.15f, 0.1f, 0.2f, 1.0f);
-  style.Colors[ImGuiCol_WindowBg] = Color(0.05f*1.3, 0.025f*1.3, 0.075f*1.3, 1.0f);
+  SDL_AudioSpec spec;
+  if (!SDL_LoadWAV(file.c_str(), &spec, &buf, &sz)) {
+    Log.push_back({ LogEntry::Type::Error, "Failed to load .wav file " + file.string() + ": " + SDL_GetError() });
+    return -1;
+  }
   
-  style.Colors[ImGuiCol_SliderGrab] = Color(0.6f, 0.4f, 0.75f, 1.0f);
-  style.Colors[ImGuiCol_SliderGrabActive] = Color(0.75f, 0.55f, 0.9f, 1.0f);
+  enum hx_format wanted_format = data->audio_stream->info.fmt;
   
-  style.Colors[ImGuiCol_FrameBg] = Color(0.15f, 0.1f, 0.2f, 0.75f);
-  style.Colors[ImGuiCol_FrameBgHovered] = Color(0.6f, 0.4f, 0.75f, 0.5f);
-  style.Colors[ImGuiCol_FrameBgActive] = Color(0.6f, 0.4f, 0.75f, 0.75);
   
-  style.Colors[ImGuiCol_TableHeaderBg] = Color(0.8f, 0.5f, 1.0f, 0.25f);
-  style.Colors[ImGuiCol_TableBorderLight] = Color(1.0f, 0.8f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TableBorderStrong] = Color(1.0f, 0.8f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TableRowBg] = Color(1.0f, 0.8f, 1.0f, 0.1f);
-  style.Colors[ImGuiCol_TableRowBgAlt] = Color(1.0f, 0.8f, 1.0f, 0.2f);
+  if (SDL_AUDIO_BITSIZE(spec.format) != 16) {
+    Log.push_back({ LogEntry::Type::Error, file.filename().string() + " is not a 16-bit .wav file" });
+    SDL_free(buf);
+    return -1;
+  }
   
-  style.Colors[ImGuiCol_PopupBg] = Color(0.10f, 0.05f, 0.15f, 1.0f);
-  style.Colors[ImGuiCol_ModalWindowDimBg] = Color(0.0f, 0.0f, 0.0f, 0.5f);
+  hx_audio_stream_t pcm;
+  pcm.size = sz;
+  pcm.data = (short*)buf;
+  pcm.info.fmt = HX_FORMAT_PCM;
+  pcm.info.sample_rate = spec.freq;
+  pcm.info.num_channels = spec.channels;
+  pcm.info.endianness = spec.format & SDL_AUDIO_MASK_ENDIAN;
+  pcm.info.num_samples = (sz / (pcm.info.num_channels * sizeof(short)));  //spec.samples * spec.freq; //(pcm.size / data->wave_header.block_alignment) / pcm.info.num_channels;;
   
-  style.Colors[ImGuiCol_CheckMark] = Color(0.0f, 1.0f, 0.5f, 0.75f);
+  Log.push_back({ LogEntry::Type::Info, "Encoding " + file.filename().string() + " (" + hx_format_name(pcm.info.fmt) + " -> " + hx_format_name(wanted_format) + ")" });
+  
+//  switch (wanted_codec) {
+//    case HX_FORMAT_PCM:
+//      *data->audio_stream = pcm;
+//      break;
+//    case HX_FORMAT_DSP:
+//      dsp_encode(hx_ctx, &pcm, data->audio_stream);
+//      break;
+//    default:
+//      break;
+//  }
+  
+  PROFILE_ZONE("hx_audio_convert");
+  if (hx_audio_convert(&pcm, data->audio_stream) < 0) {
+    Log.push_back({ LogEntry::Type::Error, "Failed to convert audio stream: unsupported formats" });
+    SDL_free(buf);
+    return -1;
+  }
+  
+  MarkDirty(hx_context_find_entry(hx_ctx, data->audio_stream->wavefile_cuuid), true);
+  SDL_free(buf);
+  return 1;
+}
+
+/* The events reaching the selected object, recomputed only when the selection or the
+ * reference index changes */
+struct ReachCache {
+  std::weak_ptr<ReferenceIndex> index;
+  uint64_t version = 0;
+  uint64_t cuuid = 0;
+  size_t events = 0;
+};
+
+static ReachCache Reached;
+
+static size_t EventsReaching(uint64_t cuuid) {
+  bool same_index = !Reached.index.owner_before(References) && !References.owner_before(Reached.index) && !Reached.index.expired();
+  if (!same_index || Reached.version != References->version || Reached.cuuid != cuuid) {
+    Reached = { References, References->version, cuuid, References->Events(cuuid).size() };
+  }
+  return Reached.events;
+}
+
+static void DrawObjectWindow() {
+  PROFILE_ZONE("DrawObjectWindow");
+  ImGui::Begin("Object Window");
+  if (SelectedObject) {
+    char name[HX_STRING_MAX_LENGTH];
+    snprintf(name, HX_STRING_MAX_LENGTH, "%016llX\n", SelectedObject->cuuid);
+    ImGui::Text("%s", name);
+    
+    hx_class_name(SelectedObject->i_class, hx_context_version(hx_ctx), name, HX_STRING_MAX_LENGTH);
+    ImGui::TextDisabled("%s @ %X\n", name, SelectedObject->file_offset);
+    
+    ImGui::Separator();
+    ImGui::Spacing();
+    
+    if (SelectedObject->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
+      hx_event_resource_data_t *data = DeferredEdit(SelectedObject, DeferredEventEdits);
+      bool edited = false;
+      edited |= ImGui::InputText("Name", data->name, HX_STRING_MAX_LENGTH);
+      edited |= ImGui::InputFloat("C0", &data->c[0]);
+      edited |= ImGui::InputFloat("C1", &data->c[1]);
+      edited |= ImGui::InputFloat("C2", &data->c[2]);
+      edited |= ImGui::InputFloat("C3", &data->c[3]);
+      if (edited && !ContextBusy()) MarkDirty(SelectedObject);
+    } else if (SelectedObject->i_class == HX_CLASS_WAVE_RESOURCE_DATA) {
+      hx_wav_resource_data_t *data = DeferredEdit(SelectedObject, DeferredWaveEdits);
+      bool edited = false;
+      edited |= ImGui::InputScalar("Flags", ImGuiDataType_S8, &data->res_data.flags);
+      edited |= ImGui::InputFloat("C0", &data->res_data.c[0]);
+      edited |= ImGui::InputFloat("C1", &data->res_data.c[1]);
+      edited |= ImGui::InputFloat("C2", &data->res_data.c[2]);
+      if (edited && !ContextBusy()) MarkDirty(SelectedObject);
+    } else if (SelectedObject->i_class == HX_CLASS_WAVE_FILE_ID_OBJECT) {
+      hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(SelectedObject->data);
+      ImGui::TextDisabled("%s, (%d) ch %s", data->ext_stream_size==0 ? "Internal" : "External", data->audio_stream->info.num_channels, hx_format_name(data->audio_stream->info.fmt));
+      ImGui::TextDisabled("Size: %d bytes", hx_audio_stream_size(data->audio_stream));
+      
+      /* Streams are shared with the workers reading the context */
+      ImGui::BeginDisabled(ContextBusy());
+      if (data->ext_stream_size>0) {
+        ImGui::SetNextItemWidth(100);
+        if (ImGui::InputText("Ext. File", data->ext_stream_filename, HX_STRING_MAX_LENGTH)) MarkDirty(SelectedObject);
+        ImGui::TextDisabled("(offset 0x%X)", data->ext_stream_offset);
+      }
+      
+      ImGui::SetNextItemWidth(100);
+      if (ImGui::InputScalar("Sample rate", ImGuiDataType_U32, &data->audio_stream->info.sample_rate, nullptr, nullptr, "%d Hz")) {
+        data->audio_stream->info.sample_rate = std::clamp((int)data->audio_stream->info.sample_rate, 1, 88200);
+        MarkDirty(SelectedObject);
+      }
+      ImGui::EndDisabled();
+      
+      ImGui::Spacing();
+      
+      static bool hovered = false;
+      ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1.0f, 0.75f, 1.0f, hovered ? 0.1f : 0.025f));
+      ImGui::BeginChild("##WavDragDrop", ImVec2(0, 40), ImGuiChildFlags_Border);
+      ImGui::TextWrapped("Drop a .wav file here to replace this stream");
+      ImGui::EndChild();
+      ImGui::PopStyleColor();
+      hovered = ImGui::IsItemHovered();
+      
+      /* Dropped anywhere else, the file is opened as a bank by the main loop */
+      if (!DroppedFile.empty() && DroppedFile.extension() == ".wav" && ImGui::IsMouseHoveringRect(ImGui::GetItemRectMin(), ImGui::GetItemRectMax())) {
+        ReplaceWaveFile(data, DroppedFile);
+        DroppedFile.clear();
+      }
+    }
+    
+    if (References) {
+      const std::pmr::vector<hx_entry_t*>& users = References->UsedBy(SelectedObject->cuuid);
+      ImGui::Spacing();
+      ImGui::Separator();
+      if (ImGui::TreeNodeEx("##UsedBy", ImGuiTreeNodeFlags_DefaultOpen, "Used by (%zu)", users.size())) {
+        hx_entry_t *select = nullptr;
+        for (hx_entry_t *user : users) {
+          ImGui::PushID(user);
+          hx_class_name(user->i_class, hx_context_version(hx_ctx), name, HX_STRING_MAX_LENGTH);
+          if (user->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
+            if (ImGui::Selectable(static_cast<hx_event_resource_data_t*>(user->data)->name)) select = user;
+          } else {
+            char label[HX_STRING_MAX_LENGTH + 32];
+            snprintf(label, sizeof(label), "%016llX (%s)", (unsigned long long)user->cuuid, name);
+            if (ImGui::Selectable(label)) select = user;
+          }
+          ImGui::PopID();
+        }
+        if (users.size() > 0 && SelectedObject->i_class != HX_CLASS_EVENT_RESOURCE_DATA) {
+          ImGui::TextDisabled("Reached from %zu events", EventsReaching(SelectedObject->cuuid));
+        }
+        ImGui::TreePop();
+        if (select) SelectedObject = select;
+      }
+    }
+  }
+  ImGui::End();
+}
+
+static char SearchText[256] = "";
+static std::string SearchQuery;
+static double SearchMilliseconds = 0.0;
+
+/* An event of a bank that is still being parsed, as recorded in its sidecar */
+static void DrawPreviewRow(const Sidecar& sidecar, uint32_t row, const char* bank) {
+  const SidecarEvent& event = sidecar.events[row];
+  ImGui::PushID(row);
+  ImGui::TableNextColumn();
+  ImGui::TableNextColumn();
+  ImGui::TextDisabled("%s", sidecar.String(event.name_offset));
+  
+  if (ImGui::IsItemHovered()) {
+    ImGui::BeginTooltip();
+    ImGui::TextDisabled("0x%016llX (loading)", (unsigned long long)event.cuuid);
+    /* Event -> resource -> wave file object */
+    auto streams = [&](uint64_t cuuid) {
+      for (auto [it, end] = sidecar.Links(cuuid); it != end; it++) {
+        if (const SidecarStream *stream = sidecar.Stream(it->to))
+          ImGui::TextDisabled("   %s @ 0x%llX, %llu bytes", stream->filename_offset ? sidecar.String(stream->filename_offset) : "internal",
+            (unsigned long long)stream->offset, (unsigned long long)stream->size);
+      }
+    };
+    for (auto [it, end] = sidecar.Links(event.cuuid); it != end; it++) {
+      ImGui::Text("-> 0x%016llX", (unsigned long long)it->to);
+      streams(it->to);
+    }
+    ImGui::EndTooltip();
+  }
+  
+  if (bank) {
+    ImGui::TableNextColumn();
+    ImGui::TextDisabled("%s", bank);
+  }
+  ImGui::PopID();
+}
+
+static void DrawEntries() {
+  PROFILE_ZONE("DrawEntries");
+  ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(4,4));
+  ImGui::Begin("Events", NULL, ImGuiWindowFlags_NoDecoration & ~ImGuiWindowFlags_NoScrollbar);
+  ImGui::PushStyleVar(ImGuiStyleVar_CellPadding, ImVec2(2,1));
+  
+  if (!Workspace.empty()) {
+    ImGui::SetNextItemWidth(-1);
+    bool changed = ImGui::InputTextWithHint("##Search", "Search names or uuid", SearchText, sizeof(SearchText));
+    if (changed || SearchStale) {
+      uint64_t begin = ProfileNow();
+      std::string query = SearchText;
+      /* Typing more characters can only narrow the results */
+      bool refine = !SearchStale && !SearchQuery.empty() && query.starts_with(SearchQuery);
+      for (auto& bank : Workspace) {
+        std::vector<uint32_t> previous;
+        if (refine) previous.swap(bank->results);
+        bank->search->Query(query, refine ? &previous : nullptr, bank->results);
+      }
+      SearchQuery = query;
+      SearchStale = false;
+      SearchMilliseconds = (ProfileNow() - begin) / 1'000'000.0;
+    }
+    
+    /* One list over every bank of the workspace */
+    std::vector<size_t> offsets = { 0 };
+    for (auto& bank : Workspace) offsets.push_back(offsets.back() + bank->results.size());
+    bool combined = Workspace.size() > 1;
+    
+    if (SearchText[0] != '\0') ImGui::TextDisabled("%zu matches (%.3f ms)", offsets.back(), SearchMilliseconds);
+    
+    if (ImGui::BeginTable("table", combined ? 3 : 2, ImGuiTableFlags_SizingFixedFit)) {
+      ImGuiListClipper clipper;
+      clipper.Begin((int)offsets.back());
+      while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+          size_t b = std::upper_bound(offsets.begin(), offsets.end(), (size_t)row) - offsets.begin() - 1;
+          Bank *bank = Workspace[b].get();
+          uint32_t result = bank->results[row - offsets[b]];
+          const SearchIndex::Row& r = bank->search->rows[result];
+          hx_entry_t *entry = r.entry;
+          
+          if (!entry) {
+            DrawPreviewRow(*bank->sidecar, result, combined ? bank->path.filename().c_str() : nullptr);
+            continue;
+          }
+          
+          hx_size_t i = r.index;
+          hx_event_resource_data_t *data = (hx_event_resource_data_t*)entry->data;
+          bool active = bank == ActiveBank;
+          
+          ImVec4 color = (active && i == SelectedEntryIndex) ? ImVec4(1.0f, 0.7f, 0.4f, 1.0f) : EntryColor(entry);
+          ImGui::PushStyleColor(ImGuiCol_Text, color);
+          ImGui::PushID(row);
+          ImGui::TableNextColumn();
+          
+          ImGui::SetCursorPosY(ImGui::GetCursorPosY()-1);
+          
+          if (DrawPlayButton(i, AudioPositionTotal != 0 && PlayingEvent == entry && SDL_GetAudioStatus() == SDL_AUDIO_PLAYING)) {
+            if (PlayingEvent && PlayingEvent == entry && SDL_GetAudioStatus() == SDL_AUDIO_PLAYING) {
+              AudioClear();
+              PlayingEvent = nullptr;
+              SDL_CloseAudio();
+            } else {
+              ActivateBank(bank);
+              if (bank == ActiveBank) QueueAudioEntry(entry);
+            }
+          }
+          
+          ImGui::TableNextColumn();
+          
+          if (ImGui::Selectable(data->name, active && SelectedEntryIndex == i)) {
+            ActivateBank(bank);
+            if (bank == ActiveBank) {
+              SelectedEvent = entry;
+              SelectedEntryIndex = i;
+            }
+          }
+          
+          if (combined) {
+            ImGui::TableNextColumn();
+            ImGui::TextDisabled("%s", bank->path.filename().c_str());
+          }
+          
+          ImGui::PopID();
+          ImGui::PopStyleColor();
+        }
+      }
+      
+      ImGui::EndTable();
+    }
+  }
+  
+  ImGui::PopStyleVar(2);
+  ImGui::End();
+}
+
+/* Indices of the entries that pass the level and text filters */
+static std::vector<uint64_t> LogView;
+static uint64_t LogViewEnd = 0;
+static unsigned int LogLevels = 0xF;
+static ImGuiTextFilter LogFilter;
+
+static void UpdateLogView(bool rebuild) {
+  if (rebuild) {
+    LogView.clear();
+    LogViewEnd = 0;
+  }
+  
+  uint64_t begin = Log.Begin();
+  LogView.erase(LogView.begin(), std::lower_bound(LogView.begin(), LogView.end(), begin));
+  LogViewEnd = std::max(LogViewEnd, begin);
+  
+  LogEntry::Type type;
+  char text[LogRing::MaxLength];
+  for (uint64_t end = Log.End(); LogViewEnd < end; LogViewEnd++) {
+    if (!Log.Read(LogViewEnd, type, text)) {
+      /* Still being written; pick it up next frame */
+      if (LogViewEnd >= Log.Begin()) break;
+      continue;
+    }
+    if (!(LogLevels & (1 << type))) continue;
+    if (!LogFilter.PassFilter(text)) continue;
+    LogView.push_back(LogViewEnd);
+  }
 }
 
-static void Layout(ImGuiID dockspaceId) {
-  ImGui::DockBuilderRemoveNode(dockspaceId);
-  ImGui::DockBuilderAddNode(dockspaceId, ImGuiDockNodeFlags_DockSpace | ImGuiDockNodeFlags_NoDockingOverCentralNode);
-  ImGui::DockBuilderSetNodeSize(dockspaceId, ImGui::GetMainViewport()->WorkSize);
+static void DrawLog() {
+  PROFILE_ZONE("DrawLog");
+  ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(3,2));
+  ImGui::Begin("Log Window", NULL, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
   
-  ImGuiID dock_main_id = dockspaceId;
-  ImGuiID left3 = ImGui::DockBuilderSplitNode(dock_main_id, ImGuiDir_Left, 0.25f, nullptr, &dock_main_id);
-  ImGuiID middle1 = dock_main_id;
-  ImGuiID middle2 = ImGui::DockBuilderSplitNode(dock_main_id, ImGuiDir_Down, 0.45f, nullptr, &middle1);
-  ImGuiID middle3 = ImGui::DockBuilderSplitNode(middle2, ImGuiDir_Down, 0.66f, nullptr, &middle2);
-  ImGuiID right1 = ImGui::DockBuilderSplitNode(middle1, ImGuiDir_Right, 0.33f, nullptr, &middle1);
+  static const char* LevelNames[] = { "status", "info", "warning", "error" };
+  static const ImVec4 LevelColors[] = {
+    ImVec4(0.3f, 1.0f, 0.6f, 1.0), ImVec4(0.2f, 0.5f, 1.0f, 1.0),
+    ImVec4(1.0f, 0.6f, 0.0f, 1.0), ImVec4(1.0f, 0.3f, 0.4f, 1.0),
+  };
   
-  ImGui::DockBuilderDockWindow("Events", left3);
-  ImGui::DockBuilderDockWindow("Info", middle1);
-  ImGui::DockBuilderDockWindow("Audio Player", middle2);
-  ImGui::DockBuilderDockWindow("Log Window", middle3);
-  ImGui::DockBuilderDockWindow("Object Window", right1);
+  bool rebuild = false;
+  for (int i = 0; i < 4; i++) {
+    ImGui::PushStyleColor(ImGuiCol_Text, LevelColors[i]);
+    rebuild |= ImGui::CheckboxFlags(LevelNames[i], &LogLevels, 1 << i);
+    ImGui::PopStyleColor();
+    ImGui::SameLine();
+  }
+  rebuild |= LogFilter.Draw("##LogFilter", -1.0f);
   
-  ImGui::DockBuilderFinish(dockspaceId);
-  Style();
-}
-
-static ImVec4 EntryColor(hx_entry_t *e) {
-  switch (e->i_class) {
-    case HX_CLASS_EVENT_RESOURCE_DATA: {
-      hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(e->data);
-      float y = 2.2f * (uint8_t(data->name[6] *-2) / 255.0f);
-      float w = 6.2f * (uint8_t(data->name[7] *-1) / 255.0f);
-      return ImVec4(0.6f*y, 0.5f, 1.0f*w, 1.0f);
-    }
+  UpdateLogView(rebuild);
+  
+  ImGui::BeginChild("LogLines");
+  if (ImGui::IsWindowHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Right)) {
+    Log.clear();
+    UpdateLogView(true);
+  }
+  
+  bool follow = ImGui::GetScrollY() >= ImGui::GetScrollMaxY();
+  
+  ImGuiListClipper clipper;
+  clipper.Begin((int)LogView.size());
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+      LogEntry::Type type;
+      char text[LogRing::MaxLength];
+      if (!Log.Read(LogView[row], type, text)) {
+        ImGui::TextDisabled("[overwritten]");
+        continue;
+      }
       
-    case HX_CLASS_WAVE_RESOURCE_DATA: {
-      return ImVec4(1.0f, 0.7f, 0.1f, 0.5f);
-    }
+      ImVec4 color = LevelColors[type];
+      ImVec4 color2 = color;
+      color2.w = 0.75f;
+      ImGui::TextColored(color, "[%s]", LevelNames[type]);
+      ImGui::SameLine();
       
-    case HX_CLASS_WAVE_FILE_ID_OBJECT: {
-      return ImVec4(1.0f, 0.7f, 0.1f, 0.9f);
+      ImGui::PushID(row);
+      ImGui::PushStyleColor(ImGuiCol_Text, color2);
+      ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0,0,0,0));
+      ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0,1));
+      ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+      ImGui::InputText("##", text, strlen(text) + 1, ImGuiInputTextFlags_ReadOnly);
+      ImGui::PopStyleVar();
+      ImGui::PopStyleColor(2);
+      ImGui::PopID();
     }
-      
-    default: return ImVec4(1.0f, 1.0f, 1.0f, 0.6f);
   }
+  
+  if (follow) ImGui::SetScrollHereY(1.0f);
+  ImGui::EndChild();
+    
+  ImGui::End();
+  ImGui::PopStyleVar();
 }
 
-static bool DrawPlayButton(int id, bool paused = false, bool s = true) {
-  ImVec2 size = s ? ImVec2(15,15) : ImVec2(ImGui::GetFrameHeight(), ImGui::GetFrameHeight());
-  ImVec4 text = paused ? ImVec4(1.0f, 0.75f, 0.25f, 0.75f) : ImVec4(0.25f, 1.0f, 0.43f, 0.75f);
-  ImVec4 background = ImVec4(text.x, text.y, text.z, 0.15f);
-  ImGui::PushStyleColor(ImGuiCol_Text, paused ? ImVec4(0,0,0,0) : text);
-  ImGui::PushStyleColor(ImGuiCol_Button, background);
-  ImGui::PushStyleVar(ImGuiStyleVar_FrameRounding, 5.0f);
-  
-  ImVec2 cursor = ImGui::GetCursorScreenPos();
-  s = ImGui::ArrowButtonEx(std::to_string(id).c_str(), ImGuiDir_Right, size);
-  
-  if (paused) {
-    ImDrawList *drawlist = ImGui::GetWindowDrawList();
-    ImVec2 p0 = cursor;
-    p0.x += size.x / 4.0f+1;
-    p0.y += size.y / 4.0f;
-    ImVec2 p1 = ImVec2(p0.x, p0.y + size.y/2.0f);
+struct SaveFormat {
+  enum hx_version version;
+  const char* extension;
+  const char* name;
+};
 
-    drawlist->AddLine(p0, p1, ImGui::GetColorU32(text), 2);
-    p0.x = cursor.x + size.x - size.x / 3.0-1;
-    p1.x = cursor.x + size.x - size.x / 3.0-1;
-    drawlist->AddLine(p0, p1, ImGui::GetColorU32(text), 2);
-  }
+static const SaveFormat SaveFormats[] = {
+  { HX_VERSION_HXC, ".hxc", "HXC (PC)" },
+  { HX_VERSION_HX2, ".hx2", "HX2 (PlayStation 2)" },
+  { HX_VERSION_HXG, ".hxg", "HXG (GameCube)" },
+};
+
+struct NativeFormats {
+  enum hx_version version;
+  std::vector<enum hx_format> formats;
+};
+
+/* The codecs each save target plays as they are */
+static const NativeFormats NativeFormatList[] = {
+  { HX_VERSION_HXC, { HX_FORMAT_PCM, HX_FORMAT_UBI } },
+  { HX_VERSION_HX2, { HX_FORMAT_PCM, HX_FORMAT_PSX } },
+  { HX_VERSION_HXG, { HX_FORMAT_PCM, HX_FORMAT_DSP } },
+};
+
+static bool FormatNative(enum hx_format fmt, enum hx_version version) {
+  for (const NativeFormats& n : NativeFormatList)
+    if (n.version == version) return std::find(n.formats.begin(), n.formats.end(), fmt) != n.formats.end();
+  return fmt == HX_FORMAT_PCM;
+}
+
+/* libhx2 decodes every codec to PCM but only encodes DSP-ADPCM, so that is all a foreign
+ * stream can become */
+static enum hx_format ConvertedFormat(enum hx_version version) {
+  return version == HX_VERSION_HXG ? HX_FORMAT_DSP : HX_FORMAT_PCM;
+}
+
+/* hx_audio_convert goes to or from PCM; other pairs are decoded to PCM first */
+static int ConvertStream(hx_audio_stream_t *in, hx_audio_stream_t *out) {
+  if (in->info.fmt == HX_FORMAT_PCM || out->info.fmt == HX_FORMAT_PCM) return hx_audio_convert(in, out);
   
-  ImGui::PopStyleColor(2);
-  ImGui::PopStyleVar();
-  return s;
+  hx_audio_stream_t pcm = {};
+  pcm.info = in->info;
+  pcm.info.fmt = HX_FORMAT_PCM;
+  pcm.wavefile_cuuid = in->wavefile_cuuid;
+  if (hx_audio_convert(in, &pcm) < 0) return -1;
+  int result = hx_audio_convert(&pcm, out);
+  hx_audio_stream_dealloc(&pcm);
+  return result;
 }
 
-static void DrawAudioPlayer() {
-  ImGui::Begin("Audio Player", NULL, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+/* Wave objects whose encoded streams are byte-identical. The first member of a group is its canonical copy. */
+static std::vector<std::vector<hx_wave_file_id_object_t*>> FindDuplicateStreams(hx_t *ctx) {
+  std::vector<hx_wave_file_id_object_t*> objects;
+  for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) {
+    hx_entry_t *e = hx_context_get_entry(ctx, i);
+    if (e->i_class != HX_CLASS_WAVE_FILE_ID_OBJECT) continue;
+    hx_wave_file_id_object_t *obj = static_cast<hx_wave_file_id_object_t*>(e->data);
+    if (obj->audio_stream && obj->audio_stream->data && obj->audio_stream->size > 0) objects.push_back(obj);
+  }
   
-  ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1.0f, 0.75f, 1.0f, 0.025f));
-  ImGui::PushStyleVar(ImGuiStyleVar_ChildRounding, 5.0f);
-  ImGui::BeginChild("AudioPlayerGroup", ImVec2(ImGui::GetContentRegionAvail().x / 1.5f, 0.0f), ImGuiChildFlags_Border);
-    if (PlayingEvent) {
-      ImGui::Text("%s", PlayingEvent ? ((hx_event_resource_data*)PlayingEvent->data)->name : "");
-      ImGui::SameLine();
-      ImGui::TextDisabled("B:%d/%d Q:%d/%d\n", AudioPositionTotal, AudioLength, AudioQueueIndex+1, AudioQueue.size()+AudioSwapQueue.size());
-      
-      
-      ImGui::SameLine();
-      ImVec2 p = ImGui::GetCursorPos();
-      ImGui::SetCursorPosX(ImGui::GetCursorPosX() + 10);
-      ImGui::SetCursorPosY(ImGui::GetCursorPosY() + ImGui::GetTextLineHeightWithSpacing() / 2.0f - 1);
-      
-      ImDrawList *drawlist =  ImGui::GetWindowDrawList();
-      drawlist->AddCircle(ImGui::GetCursorScreenPos(), 5.0f, ImColor(1.0f, 0.5f, 0.2f, 0.25f));
-      if (AudioQueue.size()>0) drawlist->PathArcTo(ImGui::GetCursorScreenPos(), 5.0f, -M_PI_2, float(AudioPosition) / float(AudioQueue.front()->size) * M_PI * 2 - M_PI_2);
-      drawlist->PathStroke(ImColor(1.0f,0.8f,0.3f,1.0f), 0, 2.0f);
-      
-      ImGui::SetCursorPos(p);
-      ImGui::NewLine();
-      
-      
-      unsigned int bytes_per_sec = AudioChannelCount * AudioSampleRate * 2;
-      float sec = float(AudioLength - AudioPositionTotal) / bytes_per_sec;
-      int min = int(sec / 60.0f) % 60;
-      
-      char buf[HX_STRING_MAX_LENGTH];
-      snprintf(buf, HX_STRING_MAX_LENGTH, "%02d:%02d:%06.3f", 0, min, fmod(sec, 60.0f));
-      ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0,2));
-      ImGui::PushStyleVar(ImGuiStyleVar_GrabRounding, 5.0f);
-      ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.85f, 1.0f, 1.0f));
-      ImGui::SetNextItemWidth(-1.0f);
-      ImGui::SliderInt("##Duration", &AudioPositionTotal, 0, AudioLength, buf, ImGuiSliderFlags_ReadOnly | ImGuiSliderFlags_NoInput);
-      ImGui::PopStyleColor();
-      ImGui::PopStyleVar(2);
-      
-      SDL_AudioStatus status = SDL_GetAudioStatus();
-      if (DrawPlayButton(0, status != SDL_AUDIO_PAUSED, false)) {
-        if (AudioQueue.size() > 0) {
-          SDL_PauseAudio(status != SDL_AUDIO_PAUSED);
-        } else {
-          /* Enqueue the last played event */
-          QueueAudioEntry(PlayingEvent);
-        }
+  std::vector<uint64_t> hashes(objects.size());
+  Scheduler->ParallelFor(TaskPriority::Interactive, objects.size(), [&](size_t i) {
+    hx_audio_stream_t *s = objects[i]->audio_stream;
+    hashes[i] = HashBytes(s->data, s->size, s->info.fmt);
+  });
+  
+  std::unordered_map<uint64_t, std::vector<std::vector<hx_wave_file_id_object_t*>>> buckets;
+  for (size_t i = 0; i < objects.size(); i++) {
+    hx_audio_stream_t *s = objects[i]->audio_stream;
+    auto& groups = buckets[hashes[i]];
+    bool found = false;
+    for (auto& g : groups) {
+      hx_audio_stream_t *c = g.front()->audio_stream;
+      if (c->info.fmt == s->info.fmt && c->size == s->size && memcmp(c->data, s->data, s->size) == 0) {
+        g.push_back(objects[i]);
+        found = true;
+        break;
       }
-      
-      ImGui::SameLine();
-    } else {
-      ImGui::TextDisabled("The audio queue is empty.");
     }
+    if (!found) groups.push_back({ objects[i] });
+  }
   
-  ImGui::Checkbox("Repeat", &AudioRepeat);
-  ImGui::SameLine();
-  ImGui::PushStyleVar(ImGuiStyleVar_GrabRounding, 5.0f);
-  ImGui::SetNextItemWidth(100.0f);
-  ImGui::SliderFloat("Volume", &AudioMixVolume, 0.0f, 1.0f);
-  ImGui::PopStyleVar();
-  ImGui::SameLine();
-  ImGui::EndChild();
+  std::vector<std::vector<hx_wave_file_id_object_t*>> duplicates;
+  for (auto& [_, groups] : buckets)
+    for (auto& g : groups) if (g.size() > 1) duplicates.push_back(std::move(g));
+  return duplicates;
+}
+
+/* A stream of the context temporarily replaced by its converted copy for a save */
+struct BorrowedStream {
+  hx_audio_stream_t *stream;
+  hx_audio_stream_t original;
+};
+
+/* Re-encodes the streams the target version cannot play into copies owned by the save,
+ * and swaps them into the context for the duration of the write (see RestoreStreams).
+ * Identical streams are encoded once. Runs on the save worker. */
+static bool PrepareStreams(hx_t *ctx, enum hx_version version, std::vector<BorrowedStream>& borrowed) {
+  std::map<hx_audio_stream_t*, std::vector<hx_audio_stream_t*>> copies;
+  for (auto& g : FindDuplicateStreams(ctx))
+    for (size_t i = 1; i < g.size(); i++) copies[g.front()->audio_stream].push_back(g[i]->audio_stream);
   
-  ImGui::SameLine();
-  ImGui::BeginChild("AudioQueueGroup", ImVec2(0,0), ImGuiChildFlags_Border);
-  SDL_LockAudio();
-  for (auto e : AudioQueue) (e==AudioQueue.front()?ImGui::Text:ImGui::TextDisabled)("%016llX\n", e->wavefile_cuuid);
-  SDL_UnlockAudio();
-  ImGui::EndChild();
+  std::set<hx_audio_stream_t*> is_copy;
+  for (auto& [_, c] : copies) is_copy.insert(c.begin(), c.end());
   
+  std::vector<hx_audio_stream_t*> streams;
+  size_t kept = 0;
+  for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) {
+    hx_entry_t *e = hx_context_get_entry(ctx, i);
+    if (e->i_class != HX_CLASS_WAVE_FILE_ID_OBJECT) continue;
+    hx_audio_stream_t *stream = static_cast<hx_wave_file_id_object_t*>(e->data)->audio_stream;
+    if (!stream || !stream->data) continue;
+    if (FormatNative(stream->info.fmt, version)) kept++;
+    else if (!is_copy.count(stream)) streams.push_back(stream);
+  }
   
+  if (streams.empty()) return true;
   
-  ImGui::PopStyleVar();
-  ImGui::PopStyleColor();
+  enum hx_format fmt = ConvertedFormat(version);
+  std::vector<std::vector<BorrowedStream>> results(streams.size());
+  std::atomic<size_t> failed = 0;
+  Scheduler->ParallelFor(TaskPriority::Batch, streams.size(), [&](size_t i) {
+    PROFILE_ZONE("hx_audio_convert");
+    hx_audio_stream_t out = {};
+    out.info = streams[i]->info;
+    out.info.fmt = fmt;
+    out.wavefile_cuuid = streams[i]->wavefile_cuuid;
+    if (ConvertStream(streams[i], &out) < 0) {
+      failed++;
+      return;
+    }
     
-  ImGui::End();
+    /* Every stream owns its data, so duplicates get their own copy */
+    results[i].push_back({ streams[i], out });
+    auto it = copies.find(streams[i]);
+    if (it != copies.end()) {
+      for (hx_audio_stream_t *c : it->second) {
+        hx_audio_stream_t d = out;
+        d.wavefile_cuuid = c->wavefile_cuuid;
+        d.data = (short*)malloc(out.size);
+        memcpy(d.data, out.data, out.size);
+        results[i].push_back({ c, d });
+      }
+    }
+  });
+  
+  /* `original` holds the converted copy until the swap below */
+  size_t converted = 0;
+  for (auto& r : results) {
+    for (BorrowedStream& b : r) {
+      std::swap(*b.stream, b.original);
+      borrowed.push_back(b);
+      converted++;
+    }
+  }
+  
+  Log.push_back({ LogEntry::Type::Info, "Converted " + std::to_string(converted) + " streams to " + hx_format_name(fmt) +
+    " (" + std::to_string(streams.size()) + " encodes), kept " + std::to_string(kept) + " as they are" });
+  
+  if (failed > 0) Log.push_back({ LogEntry::Type::Error, std::to_string(failed.load()) + " streams could not be converted" });
+  return failed == 0;
 }
 
-static void EntryTableTree(hx_entry_t* root, int depth, std::string info = "--") {
-  if (!root) return;
- 
-  ImGui::TableNextColumn();
+/* Puts the original streams back and releases the converted copies */
+static void RestoreStreams(std::vector<BorrowedStream>& borrowed) {
+  for (BorrowedStream& b : borrowed) {
+    hx_audio_stream_dealloc(b.stream);
+    *b.stream = b.original;
+  }
+  borrowed.clear();
+}
+
+/* Serializes the bank in memory and patches the changed blocks of the existing
+ * files in place. Returns 0 when the layout changed and a full save is needed. */
+static int SaveIncremental(hx_t *ctx, const std::filesystem::path& target, size_t& patched) {
+  CaptureWrites = true;
+  bool success = hx_context_write(ctx, target.string().c_str(), hx_context_version(ctx)) >= 0;
+  CaptureWrites = false;
   
-  char out[HX_STRING_MAX_LENGTH];
+  std::map<std::string, std::vector<char>> images;
+  {
+    std::lock_guard<std::mutex> lock(FileMutex);
+    images.swap(CapturedWrites);
+  }
+  if (!success) return -1;
   
-  if (root->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
-    hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(root->data);
-    snprintf(out, HX_STRING_MAX_LENGTH, "%s\n", data->name);
-  } else {
-    snprintf(out, HX_STRING_MAX_LENGTH, "%016llX\n", root->cuuid);
+  for (auto& [destination, image] : images) {
+    std::error_code ec;
+    if (std::filesystem::file_size(destination, ec) != image.size() || ec) return 0;
+  }
+  
+  for (auto& [destination, image] : images) {
+    if (!PatchFile(destination, image, patched)) {
+      Log.push_back({ LogEntry::Type::Error, "Failed to patch " + destination + ": " + strerror(errno) });
+      return -1;
+    }
   }
+  
+  return 1;
+}
+
+static void RefreshWatchedFiles();
+
+/* Runs on the main thread once the worker is done with the context */
+static void FinishSave(bool success, std::set<hx_entry_t*> saved, bool saved_streams) {
+  if (success) {
+    for (hx_entry_t *e : saved) DirtyEntries.erase(e);
+    if (saved_streams) DirtyStreams = false;
+  }
+  
+  Saving = false;
+  StreamsBorrowed = false;
+  ApplyDeferredEdits();
+  RefreshWatchedFiles();
+}
+
+static bool VerifySaved(hx_t *ctx, const std::filesystem::path& path);
+
+/* Serializes the context as `version` on a worker. Until it finishes, the Object Window
+ * edits copies of the entries (see DeferredEdit) instead of the context being written. */
+static void Save(enum hx_version version) {
+  if (!hx_ctx || Saving) return;
+  if (LoadsPending > 0) {
+    Log.push_back({ LogEntry::Type::Warning, "Wait for the banks to finish loading before saving" });
+    return;
+  }
+  if (Payloads.reloading) {
+    Log.push_back({ LogEntry::Type::Warning, "Wait for the evicted streams to be read back before saving" });
+    return;
+  }
+  PROFILE_ZONE("Save");
+  
+  std::filesystem::path target = current_file;
+  bool convert = version != hx_context_version(hx_ctx);
+  if (convert) {
+    for (const SaveFormat& f : SaveFormats) if (f.version == version) target.replace_extension(f.extension);
     
+    /* The converted streams are swapped into the context while it is written */
+    if (StreamReaders > 0) {
+      Log.push_back({ LogEntry::Type::Warning, "Wait for the comparison or index build to finish before converting" });
+      return;
+    }
+    SDL_CloseAudio();
+    AudioClear();
+    PlayingEvent = nullptr;
+    StreamsBorrowed = true;
+  }
   
+  /* Edits to the other banks of the workspace stay unsaved */
+  std::set<hx_entry_t*> saved;
+  for (hx_entry_t *e : DirtyEntries) if (hx_context_find_entry(hx_ctx, e->cuuid) == e) saved.insert(e);
   
-  ImGui::SetCursorPosX(ImGui::GetCursorPosX() + depth * 10);
+  bool unchanged = target == current_file && !DirtyStreams;
+  if (unchanged && saved.empty()) {
+    Log.push_back({ LogEntry::Type::Info, "No unsaved changes" });
+    return;
+  }
   
-  ImGuiTableFlags flags = ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_SpanAllColumns;
+  SaveProgress = 0;
+  SaveProgressStep = 0;
+  SaveProgressTotal = 0;
+  /* Small edits to the opened bank only rewrite the blocks they touched, when the user
+   * opted out of the crash-safe path */
+  bool in_place = unchanged && PatchInPlace;
+  if (CurrentLoadStats) {
+    for (auto& [filename, _] : CurrentLoadStats->files) {
+      std::error_code ec;
+      uint64_t size = std::filesystem::file_size(filename, ec);
+      if (!ec && (!in_place || !IsResourceFile(filename))) SaveProgressTotal += size;
+    }
+  }
   
-  std::vector<hx_entry_t*> next;
-  std::vector<std::string> info_v;
+  Saving = true;
+  Log.push_back({ LogEntry::Type::Info, "Saving " + target.string() + "..." });
   
-  ImGui::PushStyleColor(ImGuiCol_Text, EntryColor(root));
-  if (ImGui::TreeNodeEx(out, flags)) {
+  hx_t *ctx = hx_ctx;
+  bool saved_streams = DirtyStreams;
+  /* libhx2 writes every payload, including the ones the memory budget evicted */
+  std::vector<PayloadRegistry::Reload> reload = Payloads.BeginReload();
+  std::shared_ptr<LoadStats> stats = CurrentLoadStats;
+  
+  Scheduler->Submit(TaskPriority::Batch, [=](TaskToken&) {
+    PROFILE_ZONE("Save");
+    uint64_t begin = ProfileNow();
     
-    if (root->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
-      hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(root->data);
-      next.push_back(hx_context_find_entry(hx_ctx, data->link));
+    bool loaded = PayloadRegistry::Load(reload, stats.get());
+    RunOnMainThread([reload] { Payloads.FinishReload(reload); });
+    if (!loaded) {
+      Log.push_back({ LogEntry::Type::Error, "Failed to save " + target.string() });
+      RunOnMainThread([=] { FinishSave(false, saved, saved_streams); });
+      return;
     }
     
-    if (root->i_class == HX_CLASS_WAVE_RESOURCE_DATA) {
-      hx_wav_resource_data_t *data = static_cast<hx_wav_resource_data_t*>(root->data);
-      if (data->default_cuuid) next.push_back(hx_context_find_entry(hx_ctx, data->default_cuuid));
-      for (unsigned int i = 0; i < data->num_links; i++) {
-        next.push_back(hx_context_find_entry(hx_ctx, data->links[i].cuuid));
-        switch(HX_BYTESWAP32(data->links[i].language)) {
-          case HX_LANGUAGE_DE: info_v.push_back("DE"); break;
-          case HX_LANGUAGE_EN: info_v.push_back("EN"); break;
-          case HX_LANGUAGE_ES: info_v.push_back("ES"); break;
-          case HX_LANGUAGE_FR: info_v.push_back("FR"); break;
-          case HX_LANGUAGE_IT: info_v.push_back("IT"); break;
-          default: break;
-        }
+    if (in_place) {
+      size_t patched = 0;
+      int result = SaveIncremental(ctx, target, patched);
+      if (result > 0) {
+        Log.push_back({ LogEntry::Type::Status, "Saved " + target.string() + " in place (" + std::to_string(saved.size()) + " entries, " +
+          std::to_string(patched) + " bytes patched in " + std::to_string((ProfileNow() - begin) / 1'000'000.0) + " ms)" });
+        if (VerifyOnSave) VerifySaved(ctx, work_directory / target);
+        RunOnMainThread([=] { FinishSave(true, saved, saved_streams); });
+        return;
+      }
+      
+      if (result < 0) {
+        Log.push_back({ LogEntry::Type::Error, "Failed to save " + target.string() });
+        RunOnMainThread([=] { FinishSave(false, saved, saved_streams); });
+        return;
       }
+      
+      Log.push_back({ LogEntry::Type::Info, "Layout changed, rewriting " + target.string() });
+      SaveProgress = 0;
+      SaveProgressStep = 0;
+    }
+    
+    std::vector<BorrowedStream> borrowed;
+    bool success = !convert || PrepareStreams(ctx, version, borrowed);
+    
+    size_t bytes = 0;
+    success = success && hx_context_write(ctx, target.string().c_str(), version) >= 0;
+    if (!CommitWriters(success, &bytes)) {
+      RestoreStreams(borrowed);
+      Log.push_back({ LogEntry::Type::Error, "Failed to save " + target.string() });
+      RunOnMainThread([=] { FinishSave(false, saved, saved_streams); });
+      return;
+    }
+    
+    double seconds = (ProfileNow() - begin) / 1e9;
+    char rate[64];
+    snprintf(rate, sizeof(rate), "%.1f MB in %.3f s, %.1f MB/s", bytes / 1e6, seconds, bytes / 1e6 / std::max(seconds, 1e-9));
+    Log.push_back({ LogEntry::Type::Status, "Successfully saved " + target.string() + " (" + std::string(rate) + ")" });
+    /* Compared while the context still holds the converted streams the file was written from */
+    if (VerifyOnSave) VerifySaved(ctx, work_directory / target);
+    RestoreStreams(borrowed);
+    RunOnMainThread([=] { FinishSave(true, saved, saved_streams); });
+  });
+}
+
+#pragma mark - Bank diff
+
+struct DiffEntry {
+  enum Kind { Added, Removed, Changed } kind;
+  uint64_t cuuid;
+  enum hx_class i_class;
+  std::string name;
+  std::string other_name;
+  bool stream_changed;
+};
+
+struct BankDiff {
+  std::filesystem::path a, b;
+  std::vector<DiffEntry> entries;
+  size_t added = 0, removed = 0, changed = 0, renamed = 0, streams = 0;
+};
+
+/* Entries of `b` compared against `a`, matched by cuuid */
+static BankDiff DiffDigests(const std::vector<EntryDigest>& a, const std::vector<EntryDigest>& b) {
+  BankDiff diff;
+  std::unordered_map<uint64_t, const EntryDigest*> index;
+  index.reserve(a.size());
+  for (auto& d : a) index[d.cuuid] = &d;
+  
+  for (auto& d : b) {
+    auto it = index.find(d.cuuid);
+    if (it == index.end()) {
+      diff.entries.push_back({ DiffEntry::Added, d.cuuid, d.i_class, d.name, "", false });
+      diff.added++;
+      continue;
     }
     
-    if (root->i_class == HX_CLASS_PROGRAM_RESOURCE_DATA) {
-      hx_program_resource_data_t *data = static_cast<hx_program_resource_data_t*>(root->data);
-      for (unsigned int i = 0; i < data->num_links; i++) {
-        next.push_back(hx_context_find_entry(hx_ctx, data->links[i]));
-      }
-    }
+    const EntryDigest& o = *it->second;
+    index.erase(it);
+    if (o.hash == d.hash && o.i_class == d.i_class) continue;
     
-    ImGui::TreePop();
+    DiffEntry e = { DiffEntry::Changed, d.cuuid, d.i_class, o.name, d.name, o.stream != d.stream };
+    diff.entries.push_back(e);
+    diff.changed++;
+    if (o.name != d.name) diff.renamed++;
+    if (e.stream_changed) diff.streams++;
   }
   
-  if (ImGui::IsItemClicked()) {
-    SelectedObject = root;
+  for (auto& d : a) {
+    if (!index.count(d.cuuid)) continue;
+    diff.entries.push_back({ DiffEntry::Removed, d.cuuid, d.i_class, d.name, "", false });
+    diff.removed++;
   }
   
-  ImGui::PopStyleColor();
-  
-  ImGui::TableNextColumn();
-  ImGui::TextDisabled(info.c_str());
-  
-  ImGui::TableNextColumn();
-  hx_class_name(root->i_class, hx_context_version(hx_ctx), out, HX_STRING_MAX_LENGTH);
-  
-  ImGui::TextDisabled(out);
-  
-  for (unsigned int i = 0; i < next.size(); i++) {
-    hx_entry_t *e = next.at(i);
-    ImGui::TableNextRow();
-    EntryTableTree(e, depth + 1, info_v.size() > 0 ? info_v[i] : "--");
+  return diff;
+}
+
+/* Opens a bank on the calling thread. `stats` must outlive the context. */
+static hx_t* OpenContext(const std::filesystem::path& path, LoadStats *stats) {
+  stats->path = path;
+  hx_t *ctx = hx_context_alloc();
+  hx_context_callback(ctx, &ReadCB, &WriteCB, &ErrorCB, stats);
+  if (hx_context_open(ctx, path.string().c_str()) < 0) {
+    hx_context_free(&ctx);
+    return nullptr;
   }
+  return ctx;
 }
 
-static void DrawInfo() {
-  ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0,0));
-  ImGui::Begin("Info", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
-  if (SelectedEvent) {
-    const ImGuiTableFlags flags =
-    ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_NoBordersInBody;
+static bool DiffWindow = false;
+static char DiffPath[1024] = "";
+static std::unique_ptr<BankDiff> CurrentDiff;
+static bool Diffing = false;
 
-    if (ImGui::BeginTable("Entries", 3, flags)) {
-      ImGui::TableSetupColumn("Name/uuid", ImGuiTableColumnFlags_WidthStretch);
-      ImGui::TableSetupColumn("Info", ImGuiTableColumnFlags_WidthFixed, 50);
-      ImGui::TableSetupColumn("Class", ImGuiTableColumnFlags_WidthFixed, 120);
-      ImGui::TableHeadersRow();
-      EntryTableTree(SelectedEvent, 0);
-      ImGui::EndTable();
+/* Compares the open bank against `path` in the background */
+static void StartDiff(std::filesystem::path path) {
+  if (!hx_ctx || Diffing || LoadsPending > 0 || StreamsBorrowed || Payloads.reloading) return;
+  Diffing = true;
+  StreamReaders++;
+  
+  hx_t *ctx = hx_ctx;
+  std::filesystem::path a = work_directory / current_file;
+  std::vector<PayloadRegistry::Reload> reload = Payloads.BeginReload();
+  std::shared_ptr<LoadStats> current = CurrentLoadStats;
+  Scheduler->Submit(TaskPriority::Batch, [=](TaskToken&) {
+    uint64_t begin = ProfileNow();
+    bool loaded = PayloadRegistry::Load(reload, current.get());
+    RunOnMainThread([reload] { Payloads.FinishReload(reload); });
+    
+    LoadStats stats;
+    hx_t *other = loaded ? OpenContext(path, &stats) : nullptr;
+    if (!other) {
+      Log.push_back({ LogEntry::Type::Error, "Failed to load file" + path.string() });
+      RunOnMainThread([] { Diffing = false; StreamReaders--; });
+      return;
     }
-  }
+    
+    std::vector<EntryDigest> da = DigestContext(ctx);
+    std::vector<EntryDigest> db = DigestContext(other);
+    hx_context_free(&other);
+    
+    auto diff = std::make_shared<BankDiff>(DiffDigests(da, db));
+    diff->a = a;
+    diff->b = path;
+    Log.push_back({ LogEntry::Type::Status, "Compared " + std::to_string(da.size()) + " / " + std::to_string(db.size()) + " entries in " +
+      std::to_string((ProfileNow() - begin) / 1'000'000.0) + " ms: " + std::to_string(diff->added) + " added, " + std::to_string(diff->removed) +
+      " removed, " + std::to_string(diff->changed) + " changed" });
+    
+    RunOnMainThread([diff] {
+      CurrentDiff = std::make_unique<BankDiff>(std::move(*diff));
+      Diffing = false;
+      StreamReaders--;
+    });
+  });
+}
+
+static void DrawDiff() {
+  if (!DiffWindow) return;
+  PROFILE_ZONE("DrawDiff");
   
+  ImGui::SetNextWindowSize(ImVec2(520, 360), ImGuiCond_FirstUseEver);
+  if (ImGui::Begin("Compare banks", &DiffWindow, ImGuiWindowFlags_NoDocking)) {
+    ImGui::SetNextItemWidth(-80.0f);
+    ImGui::InputTextWithHint("##DiffPath", "Path to the other bank", DiffPath, sizeof(DiffPath));
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!hx_ctx || Diffing);
+    if (ImGui::Button(Diffing ? "Comparing" : "Compare", ImVec2(-1, 0))) StartDiff(DiffPath);
+    ImGui::EndDisabled();
+    
+    if (CurrentDiff) {
+      BankDiff& d = *CurrentDiff;
+      ImGui::TextDisabled("%s -> %s", d.a.filename().c_str(), d.b.filename().c_str());
+      ImGui::TextDisabled("%zu added, %zu removed, %zu changed (%zu names, %zu streams)", d.added, d.removed, d.changed, d.renamed, d.streams);
+      
+      if (ImGui::BeginTable("DiffEntries", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingStretchProp)) {
+        ImGui::TableSetupColumn("Change", ImGuiTableColumnFlags_WidthFixed, 60);
+        ImGui::TableSetupColumn("Name/uuid", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Class", ImGuiTableColumnFlags_WidthFixed, 120);
+        ImGui::TableHeadersRow();
+        
+        char cls[HX_STRING_MAX_LENGTH];
+        ImGuiListClipper clipper;
+        clipper.Begin((int)d.entries.size());
+        while (clipper.Step()) {
+          for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            DiffEntry& e = d.entries[row];
+            ImGui::TableNextColumn();
+            if (e.kind == DiffEntry::Added) ImGui::TextColored(ImVec4(0.3f, 1.0f, 0.6f, 1.0f), "added");
+            if (e.kind == DiffEntry::Removed) ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.4f, 1.0f), "removed");
+            if (e.kind == DiffEntry::Changed) ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.0f, 1.0f), "changed");
+            
+            ImGui::TableNextColumn();
+            char label[2 * HX_STRING_MAX_LENGTH + 32];
+            if (e.kind == DiffEntry::Changed && e.name != e.other_name) snprintf(label, sizeof(label), "%s -> %s##%d", e.name.c_str(), e.other_name.c_str(), row);
+            else if (!e.name.empty()) snprintf(label, sizeof(label), "%s%s##%d", e.name.c_str(), e.stream_changed ? " (stream)" : "", row);
+            else snprintf(label, sizeof(label), "%016llX%s##%d", (unsigned long long)e.cuuid, e.stream_changed ? " (stream)" : "", row);
+            
+            if (ImGui::Selectable(label, false, ImGuiSelectableFlags_SpanAllColumns) && hx_ctx) {
+              if (hx_entry_t *entry = hx_context_find_entry(hx_ctx, e.cuuid)) SelectedObject = entry;
+            }
+            
+            ImGui::TableNextColumn();
+            hx_class_name(e.i_class, hx_ctx ? hx_context_version(hx_ctx) : HX_VERSION_HXC, cls, HX_STRING_MAX_LENGTH);
+            ImGui::TextDisabled("%s", cls);
+          }
+        }
+        ImGui::EndTable();
+      }
+    }
+  }
   ImGui::End();
-  ImGui::PopStyleVar();
 }
 
-static int ReplaceWaveFile(hx_wave_file_id_object_t *data, std::filesystem::path file) {
-  if (file.extension() != ".wav") return -1;
-  
-  Uint8* buf = nullptr;
-  Uint32 sz = 0;
-  
-  SDL_AudioSpec spec;
-  if (!SDL_LoadWAV(file.c_str(), &spec, &buf, &sz)) {
-    Log.push_back({ LogEntry::Type::Error, "Failed to load .wav file " + file.string() + ": " + SDL_GetError() });
-    return -1;
+static void PrintDiffJson(FILE *fp, const BankDiff& d, enum hx_version version) {
+  static const char* Kinds[] = { "added", "removed", "changed" };
+  char cls[HX_STRING_MAX_LENGTH];
+  fprintf(fp, "{\n  \"a\": \"%s\",\n  \"b\": \"%s\",\n", JsonEscape(d.a.string()).c_str(), JsonEscape(d.b.string()).c_str());
+  fprintf(fp, "  \"added\": %zu,\n  \"removed\": %zu,\n  \"changed\": %zu,\n  \"renamed\": %zu,\n  \"streams_changed\": %zu,\n",
+    d.added, d.removed, d.changed, d.renamed, d.streams);
+  fprintf(fp, "  \"entries\": [");
+  for (size_t i = 0; i < d.entries.size(); i++) {
+    const DiffEntry& e = d.entries[i];
+    hx_class_name(e.i_class, version, cls, HX_STRING_MAX_LENGTH);
+    fprintf(fp, "%s\n    { \"change\": \"%s\", \"cuuid\": \"%016llX\", \"class\": \"%s\"", i ? "," : "", Kinds[e.kind], (unsigned long long)e.cuuid, JsonEscape(cls).c_str());
+    if (!e.name.empty()) fprintf(fp, ", \"name\": \"%s\"", JsonEscape(e.name).c_str());
+    if (e.kind == DiffEntry::Changed && e.name != e.other_name) fprintf(fp, ", \"new_name\": \"%s\"", JsonEscape(e.other_name).c_str());
+    if (e.stream_changed) fprintf(fp, ", \"stream_changed\": true");
+    fprintf(fp, " }");
   }
+  fprintf(fp, "\n  ]\n}\n");
+}
+
+#pragma mark - Verification
+
+/* Re-opens `path` and checks it against the in-memory context: every entry and stream must
+ * hash the same, and every link of the saved bank must resolve. The context must not change
+ * while this runs (callers hold Saving). */
+static bool VerifySaved(hx_t *ctx, const std::filesystem::path& path) {
+  PROFILE_ZONE("VerifySaved");
+  uint64_t begin = ProfileNow();
   
-  enum hx_format wanted_format = data->audio_stream->info.fmt;
-  
-  
-  if (SDL_AUDIO_BITSIZE(spec.format) != 16) {
-    /* Conversion needed */
-    SDL_AudioCVT cvt;
-    SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq, AUDIO_S16SYS, spec.channels, spec.freq);
-    
-    cvt.len = sz;
-    cvt.buf = buf;
-    SDL_ConvertAudio(&cvt);
-    
-    return -1;
+  LoadStats stats;
+  hx_t *saved = OpenContext(path, &stats);
+  if (!saved) {
+    Log.push_back({ LogEntry::Type::Error, "Verify: failed to reopen " + path.string() });
+    return false;
   }
   
-  hx_audio_stream_t pcm;
-  pcm.size = sz;
-  pcm.data = (short*)buf;
-  pcm.info.fmt = HX_FORMAT_PCM;
-  pcm.info.sample_rate = spec.freq;
-  pcm.info.num_channels = spec.channels;
-  pcm.info.endianness = spec.format & SDL_AUDIO_MASK_ENDIAN;
-  pcm.info.num_samples = (sz / (pcm.info.num_channels * sizeof(short)));  //spec.samples * spec.freq; //(pcm.size / data->wave_header.block_alignment) / pcm.info.num_channels;;
+  BankDiff diff = DiffDigests(DigestContext(ctx), DigestContext(saved));
   
-  Log.push_back({ LogEntry::Type::Info, "Encoding " + file.filename().string() + " (" + hx_format_name(pcm.info.fmt) + " -> " + hx_format_name(wanted_format) + ")" });
+  std::mutex mutex;
+  std::vector<std::pair<uint64_t, uint64_t>> unresolved;
+  Scheduler->ParallelFor(TaskPriority::Batch, hx_context_num_entries(saved), [&](size_t i) {
+    hx_entry_t *e = hx_context_get_entry(saved, i);
+    std::vector<uint64_t> links;
+    CollectLinks(e, links);
+    for (uint64_t cuuid : links) {
+      if (!cuuid || hx_context_find_entry(saved, cuuid)) continue;
+      std::lock_guard<std::mutex> lock(mutex);
+      unresolved.push_back({ e->cuuid, cuuid });
+    }
+  });
   
-//  switch (wanted_codec) {
-//    case HX_FORMAT_PCM:
-//      *data->audio_stream = pcm;
-//      break;
-//    case HX_FORMAT_DSP:
-//      dsp_encode(hx_ctx, &pcm, data->audio_stream);
-//      break;
-//    default:
-//      break;
-//  }
+  size_t entries = hx_context_num_entries(saved);
+  hx_context_free(&saved);
   
-  if (hx_audio_convert(&pcm, data->audio_stream) < 0) {
-    Log.push_back({ LogEntry::Type::Error, "Failed to convert audio stream: unsupported formats" });
+  /* Keep the log readable on a badly broken file */
+  static constexpr size_t MaxReported = 32;
+  char line[128];
+  for (size_t i = 0; i < diff.entries.size() && i < MaxReported; i++) {
+    static const char* Kinds[] = { "missing from memory", "missing from file", "differs" };
+    const DiffEntry& e = diff.entries[i];
+    snprintf(line, sizeof(line), "Verify: %016llX %s%s", (unsigned long long)e.cuuid, Kinds[e.kind], e.stream_changed ? " (stream)" : "");
+    Log.push_back({ LogEntry::Type::Error, line });
+  }
+  for (size_t i = 0; i < unresolved.size() && i < MaxReported; i++) {
+    snprintf(line, sizeof(line), "Verify: %016llX links to missing entry %016llX",
+      (unsigned long long)unresolved[i].first, (unsigned long long)unresolved[i].second);
+    Log.push_back({ LogEntry::Type::Error, line });
+  }
+  
+  size_t problems = diff.entries.size() + unresolved.size();
+  if (problems) {
+    Log.push_back({ LogEntry::Type::Error, "Verify: " + path.string() + " has " + std::to_string(diff.entries.size()) + " mismatched entries and " +
+      std::to_string(unresolved.size()) + " unresolved links" });
+  } else {
+    Log.push_back({ LogEntry::Type::Status, "Verified " + path.string() + " (" + std::to_string(entries) + " entries in " +
+      std::to_string((ProfileNow() - begin) / 1'000'000.0) + " ms)" });
+  }
+  return problems == 0;
+}
+
+/* Verifies the opened bank against its file on disk */
+static void Verify() {
+  if (!hx_ctx || Saving || LoadsPending > 0 || Payloads.reloading) return;
+  if (ActiveBankDirty()) {
+    Log.push_back({ LogEntry::Type::Warning, "Save the bank before verifying it" });
     return;
   }
   
-  SDL_free(buf);
+  Saving = true;
+  hx_t *ctx = hx_ctx;
+  std::filesystem::path path = work_directory / current_file;
+  std::vector<PayloadRegistry::Reload> reload = Payloads.BeginReload();
+  std::shared_ptr<LoadStats> stats = CurrentLoadStats;
+  Scheduler->Submit(TaskPriority::Batch, [=](TaskToken&) {
+    bool loaded = PayloadRegistry::Load(reload, stats.get());
+    RunOnMainThread([reload] { Payloads.FinishReload(reload); });
+    if (loaded) VerifySaved(ctx, path);
+    RunOnMainThread([] { FinishSave(true, {}, false); });
+  });
 }
 
-static void DrawObjectWindow() {
-  ImGui::Begin("Object Window");
-  if (SelectedObject) {
-    char name[HX_STRING_MAX_LENGTH];
-    snprintf(name, HX_STRING_MAX_LENGTH, "%016llX\n", SelectedObject->cuuid);
-    ImGui::Text("%s", name);
-    
-    hx_class_name(SelectedObject->i_class, hx_context_version(hx_ctx), name, HX_STRING_MAX_LENGTH);
-    ImGui::TextDisabled("%s @ %X\n", name, SelectedObject->file_offset);
-    
-    ImGui::Separator();
-    ImGui::Spacing();
-    
-    if (SelectedObject->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
-      hx_event_resource_data_t *data = static_cast<hx_event_resource_data_t*>(SelectedObject->data);
-      ImGui::InputText("Name", data->name, HX_STRING_MAX_LENGTH);
-      ImGui::InputFloat("C0", &data->c[0]);
-      ImGui::InputFloat("C1", &data->c[1]);
-      ImGui::InputFloat("C2", &data->c[2]);
-      ImGui::InputFloat("C3", &data->c[3]);
-    } else if (SelectedObject->i_class == HX_CLASS_WAVE_RESOURCE_DATA) {
-      hx_wav_resource_data_t *data = static_cast<hx_wav_resource_data_t*>(SelectedObject->data);
-      ImGui::InputScalar("Flags", ImGuiDataType_S8, &data->res_data.flags);
-      ImGui::InputFloat("C0", &data->res_data.c[0]);
-      ImGui::InputFloat("C1", &data->res_data.c[1]);
-      ImGui::InputFloat("C2", &data->res_data.c[2]);
-    } else if (SelectedObject->i_class == HX_CLASS_WAVE_FILE_ID_OBJECT) {
-      hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(SelectedObject->data);
-      ImGui::TextDisabled("%s, (%d) ch %s", data->ext_stream_size==0 ? "Internal" : "External", data->audio_stream->info.num_channels, hx_format_name(data->audio_stream->info.fmt));
-      ImGui::TextDisabled("Size: %d bytes", hx_audio_stream_size(data->audio_stream));
-      
-      if (data->ext_stream_size>0) {
-        ImGui::SetNextItemWidth(100);
-        ImGui::InputText("Ext. File", data->ext_stream_filename, HX_STRING_MAX_LENGTH);
-        ImGui::TextDisabled("(offset 0x%X)", data->ext_stream_offset);
-      }
-      
-      ImGui::SetNextItemWidth(100);
-      if (ImGui::InputScalar("Sample rate", ImGuiDataType_U32, &data->audio_stream->info.sample_rate, nullptr, nullptr, "%d Hz")) {
-        data->audio_stream->info.sample_rate = std::clamp((int)data->audio_stream->info.sample_rate, 1, 88200);
-      }
-      
-      
-      ImGui::Spacing();
-      
-//      static bool hovered = false;
-//      ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(1.0f, 0.75f, 1.0f, hovered ? 0.1f : 0.025f));
-//      ImGui::BeginChild("##WavDragDrop", ImVec2(0,-1), ImGuiChildFlags_Border);
-//      ImGui::TextWrapped("Drop a .wav file here to replace this stream");
-//      ImGui::EndChild();
-//      ImGui::PopStyleColor();
-//      hovered = ImGui::IsItemHovered();
-//
-//      if (DroppedFile.string().length()>0 && ImGui::IsMouseHoveringRect(ImGui::GetItemRectMin(), ImGui::GetItemRectMax())) {
-//        ReplaceWaveFile(data, DroppedFile);
-//      }
-    }
+#pragma mark - Memory view
+
+struct MemoryLine {
+  std::string name;
+  uint64_t count;
+  uint64_t bytes;
+};
+
+/* The breakdown shared by the Memory window and --memory */
+static std::vector<MemoryLine> MemoryLines(const MemoryAccount& account, BankArena *arena, enum hx_version version) {
+  std::vector<MemoryLine> lines;
+  char name[HX_STRING_MAX_LENGTH];
+  for (auto& [i_class, c] : account.classes) {
+    hx_class_name(i_class, version, name, HX_STRING_MAX_LENGTH);
+    lines.push_back({ name, c.entries, c.bytes });
   }
-  ImGui::End();
+  
+  lines.push_back({ "Audio (encoded, in bank)", account.streams - account.external_streams, account.encoded_bytes - account.external_bytes });
+  lines.push_back({ "Audio (encoded, external)", account.external_streams, account.external_bytes });
+  lines.push_back({ "Audio (decoded PCM cache)", AudioCache.items.size(), AudioCache.bytes });
+  
+  uint64_t overhead = AudioCache.free_streams.size() * sizeof(hx_audio_stream_t) +
+    AudioCache.items.size() * (sizeof(uint64_t) + sizeof(PCMCache::Item) + 2 * sizeof(void*));
+  if (arena) {
+    lines.push_back({ "Indexes", arena->requests.allocations, arena->requests.bytes });
+    overhead += arena->blocks.bytes > arena->requests.bytes ? arena->blocks.bytes - arena->requests.bytes : 0;
+  }
+  lines.push_back({ "Allocator overhead", 0, overhead });
+  return lines;
 }
 
-static void DrawEntries() {
-  ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(4,4));
-  ImGui::Begin("Events", NULL, ImGuiWindowFlags_NoDecoration & ~ImGuiWindowFlags_NoScrollbar);
-  ImGui::PushStyleVar(ImGuiStyleVar_CellPadding, ImVec2(2,1));
+static bool MemoryWindow = false;
+
+static void DrawMemory() {
+  if (!MemoryWindow) return;
+  PROFILE_ZONE("DrawMemory");
   
-  if (hx_ctx) {
-    if (ImGui::BeginTable("table", 2, ImGuiTableFlags_SizingFixedFit)) {
-      for (hx_size_t i = 0; i < hx_context_num_entries(hx_ctx); i++) {
-        hx_entry_t *entry = hx_context_get_entry(hx_ctx, i);
-        if (entry->i_class == HX_CLASS_EVENT_RESOURCE_DATA) {
-          hx_event_resource_data_t *data = (hx_event_resource_data_t*)entry->data;
-          
-          ImVec4 color = (i == SelectedEntryIndex) ? ImVec4(1.0f, 0.7f, 0.4f, 1.0f) : EntryColor(entry);
-          ImGui::PushStyleColor(ImGuiCol_Text, color);
+  ImGui::SetNextWindowSize(ImVec2(420, 360), ImGuiCond_FirstUseEver);
+  if (ImGui::Begin("Memory", &MemoryWindow, ImGuiWindowFlags_NoDocking)) {
+    if (hx_ctx && Memory) {
+      std::vector<MemoryLine> lines = MemoryLines(*Memory, Search ? Search->memory.get() : nullptr, hx_context_version(hx_ctx));
+      uint64_t total = 0;
+      for (const MemoryLine& l : lines) total += l.bytes;
+      ImGui::TextDisabled("%.2f MB accounted", total / 1e6);
+      if (MemoryBudget > 0) {
+        ImGui::TextDisabled("Audio budget %d MiB (active bank): %llu payloads evicted, %llu reloaded", MemoryBudget,
+          (unsigned long long)Payloads.evictions, (unsigned long long)Payloads.reloads);
+      }
+      
+      if (ImGui::BeginTable("MemoryLines", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingStretchProp)) {
+        ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthFixed, 70);
+        ImGui::TableSetupColumn("Bytes", ImGuiTableColumnFlags_WidthFixed, 110);
+        ImGui::TableHeadersRow();
+        for (const MemoryLine& l : lines) {
           ImGui::TableNextColumn();
-          
-          ImGui::SetCursorPosY(ImGui::GetCursorPosY()-1);
-          
-          if (DrawPlayButton(i, AudioPositionTotal != 0 && PlayingEvent == entry && SDL_GetAudioStatus() == SDL_AUDIO_PLAYING)) {
-            if (PlayingEvent && PlayingEvent == entry && SDL_GetAudioStatus() == SDL_AUDIO_PLAYING) {
-              AudioClear();
-              PlayingEvent = nullptr;
-              SDL_CloseAudio();
-            } else {
-              QueueAudioEntry(entry);
-            }
-          }
-          
+          ImGui::Text("%s", l.name.c_str());
           ImGui::TableNextColumn();
-          
-          if (ImGui::Selectable(data->name, SelectedEntryIndex == i)) {
-            if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
-              printf("left\n");
-            }
-            
-            
-            SelectedEvent = entry;
-            SelectedEntryIndex = i;
-          }
-          
-          
-          ImGui::PopStyleColor();
+          if (l.count) ImGui::TextDisabled("%llu", (unsigned long long)l.count);
+          ImGui::TableNextColumn();
+          ImGui::Text("%.1f KiB", l.bytes / 1024.0);
         }
+        ImGui::EndTable();
       }
-      
-      ImGui::EndTable();
+    } else {
+      ImGui::TextDisabled("No bank loaded");
     }
   }
-  
-  ImGui::PopStyleVar(2);
   ImGui::End();
 }
 
-static size_t LastLogNumEntries = 0;
+static void PrintMemoryJson(FILE *fp, const std::filesystem::path& path, const std::vector<MemoryLine>& lines) {
+  uint64_t total = 0;
+  for (const MemoryLine& l : lines) total += l.bytes;
+  fprintf(fp, "{\n  \"file\": \"%s\",\n  \"total_bytes\": %llu,\n  \"lines\": [", JsonEscape(path.string()).c_str(), (unsigned long long)total);
+  for (size_t i = 0; i < lines.size(); i++) {
+    fprintf(fp, "%s\n    { \"name\": \"%s\", \"count\": %llu, \"bytes\": %llu }", i ? "," : "", JsonEscape(lines[i].name).c_str(),
+      (unsigned long long)lines[i].count, (unsigned long long)lines[i].bytes);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+}
 
-static void DrawLog() {
-  ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(3,2));
-  ImGui::Begin("Log Window");
+#pragma mark - Workspace index
+
+static bool WorkspaceWindow = false;
+static char WorkspaceLookup[32] = "";
+static bool Indexing = false;
+
+/* Rebuilds GlobalIndex in the background; the banks stay open until it finishes */
+static void BuildGlobalIndex() {
+  if (Workspace.size() < 2 || Indexing || LoadsPending > 0 || Reloading || StreamsBorrowed) return;
+  Indexing = true;
+  StreamReaders++;
   
-  if (ImGui::IsWindowHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Right)) {
-    Log.clear();
+  std::vector<std::shared_ptr<Bank>> banks = Workspace;
+  uint64_t generation = WorkspaceGeneration;
+  Scheduler->Submit(TaskPriority::Batch, [=](TaskToken&) {
+    uint64_t begin = ProfileNow();
+    std::shared_ptr<CuuidIndex> index = std::make_shared<CuuidIndex>();
+    index->Build(banks);
+    Log.push_back({ LogEntry::Type::Status, "Indexed " + std::to_string(index->definitions.size()) + " uuids across " + std::to_string(banks.size()) +
+      " banks in " + std::to_string((ProfileNow() - begin) / 1'000'000.0) + " ms: " + std::to_string(index->shared.size()) + " shared, " +
+      std::to_string(index->conflicts.size()) + " conflicting" });
+    
+    RunOnMainThread([=] {
+      Indexing = false;
+      StreamReaders--;
+      if (generation == WorkspaceGeneration) GlobalIndex = index;
+    });
+  });
+}
+
+static void DefinitionRows(uint64_t cuuid) {
+  const std::vector<CuuidIndex::Definition>* defs = GlobalIndex->Find(cuuid);
+  if (!defs) return;
+  
+  char cls[HX_STRING_MAX_LENGTH];
+  for (const CuuidIndex::Definition& d : *defs) {
+    hx_class_name(d.entry->i_class, hx_context_version(d.bank->ctx), cls, HX_STRING_MAX_LENGTH);
+    char label[HX_STRING_MAX_LENGTH * 2 + 32];
+    snprintf(label, sizeof(label), "%016llX  %s  %s##%p", (unsigned long long)cuuid, d.bank->path.filename().c_str(), cls, (void*)d.entry);
+    if (ImGui::Selectable(label, d.entry == SelectedObject)) JumpTo(d.bank, d.entry);
   }
+}
+
+static void DrawWorkspaceIndex() {
+  if (!WorkspaceWindow) return;
+  PROFILE_ZONE("DrawWorkspaceIndex");
   
-  for (auto& line : Log) {
-    ImVec4 color;
-    std::string type;
-    if (line.type == LogEntry::Status) color = ImVec4(0.3f, 1.0f, 0.6f, 1.0);
-    if (line.type == LogEntry::Info) color = ImVec4(0.2f, 0.5f, 1.0f, 1.0);
-    if (line.type == LogEntry::Warning) color = ImVec4(1.0f, 0.6f, 0.0f, 1.0);
-    if (line.type == LogEntry::Error) color = ImVec4(1.0f, 0.3f, 0.4f, 1.0);
-    if (line.type == LogEntry::Status) type = "status";
-    if (line.type == LogEntry::Info) type = "info";
-    if (line.type == LogEntry::Warning) type = "warning";
-    if (line.type == LogEntry::Error) type = "error";
-    
-    ImVec4 color2 = color;
-    color2.w = 0.75f;
-    ImGui::TextColored(color, "[%s]", type.c_str());
+  ImGui::SetNextWindowSize(ImVec2(480, 360), ImGuiCond_FirstUseEver);
+  if (ImGui::Begin("Workspace", &WorkspaceWindow, ImGuiWindowFlags_NoDocking)) {
+    ImGui::TextDisabled("%zu banks", Workspace.size());
     ImGui::SameLine();
+    ImGui::BeginDisabled(Workspace.size() < 2 || Indexing || LoadsPending > 0 || Reloading);
+    if (ImGui::SmallButton(Indexing ? "Indexing" : "Rebuild index")) BuildGlobalIndex();
+    ImGui::EndDisabled();
     
-    ImGui::PushStyleColor(ImGuiCol_Text, color2);
-    ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0,0,0,0));
-    ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0,1));
-    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
-    ImGui::InputText(("##" + std::to_string(&line - Log.data())).c_str(), (char*)line.text.c_str(), line.text.length(), ImGuiInputTextFlags_ReadOnly);
-    ImGui::PopStyleVar();
-    ImGui::PopStyleColor(2);
+    if (GlobalIndex) {
+      ImGui::SetNextItemWidth(-1);
+      ImGui::InputTextWithHint("##Lookup", "Look up a uuid", WorkspaceLookup, sizeof(WorkspaceLookup), ImGuiInputTextFlags_CharsHexadecimal);
+      uint64_t lo, hi;
+      std::string query = SearchIndex::Lower(WorkspaceLookup);
+      if (query.size() == 16 && SearchIndex::CuuidRange(query, lo, hi)) {
+        if (GlobalIndex->Find(lo)) DefinitionRows(lo);
+        else ImGui::TextDisabled("Not defined in any bank");
+      }
+      
+      ImGui::Separator();
+      ImGui::TextDisabled("%zu conflicting, %zu shared uuids", GlobalIndex->conflicts.size(), GlobalIndex->shared.size());
+      if (ImGui::BeginChild("Conflicts")) {
+        ImGuiListClipper clipper;
+        clipper.Begin((int)GlobalIndex->conflicts.size());
+        while (clipper.Step()) {
+          for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            ImGui::PushID(row);
+            DefinitionRows(GlobalIndex->conflicts[row]);
+            ImGui::PopID();
+          }
+        }
+      }
+      ImGui::EndChild();
+    }
   }
-  
-  if (LastLogNumEntries != Log.size()) ImGui::SetScrollHereY();
-    
   ImGui::End();
-  ImGui::PopStyleVar();
-  
-  LastLogNumEntries = Log.size();
-}
-
-static void Save() {
-  hx_context_write(hx_ctx, "out.hxc", HX_VERSION_HXC);
-  Log.push_back({ LogEntry::Type::Status, "Successfully saved out.hxc" });
 }
 
 static void DrawMainMenuBar() {
+  PROFILE_ZONE("DrawMainMenuBar");
   if (ImGui::BeginMainMenuBar()) {
     if (ImGui::BeginMenu("File")) {
-     // if (ImGui::MenuItem("Save")) Save();
+      if (ImGui::MenuItem("Save", "Ctrl+S", false, hx_ctx != nullptr && !Saving)) WantsSave = true;
+      if (ImGui::BeginMenu("Save as", hx_ctx != nullptr && !Saving)) {
+        for (const SaveFormat& f : SaveFormats) {
+          if (ImGui::MenuItem(f.name, f.extension, f.version == hx_context_version(hx_ctx))) Save(f.version);
+        }
+        ImGui::EndMenu();
+      }
+      if (ImGui::MenuItem("Verify after saving", nullptr, &VerifyOnSave)) SaveConfig();
+      if (ImGui::MenuItem("Patch banks in place", nullptr, &PatchInPlace)) SaveConfig();
+      if (ImGui::IsItemHovered()) ImGui::SetTooltip("Small edits overwrite only the changed blocks of the bank.\n"
+        "The bank is still serialized in full, and a crash during the write can corrupt it.");
       ImGui::Separator();
       if (ImGui::MenuItem("Exit")) WantsQuit = true;
       ImGui::EndMenu();
     }
     
+    if (ImGui::BeginMenu("Tools")) {
+      if (ImGui::MenuItem("Compare banks...", nullptr, &DiffWindow) && DiffPath[0] == '\0')
+        snprintf(DiffPath, sizeof(DiffPath), "%s", work_directory.string().c_str());
+      if (ImGui::MenuItem("Verify saved bank", nullptr, false, hx_ctx != nullptr && !Saving)) Verify();
+      ImGui::MenuItem("Memory", nullptr, &MemoryWindow);
+      ImGui::MenuItem("Workspace", nullptr, &WorkspaceWindow);
+      ImGui::EndMenu();
+    }
+    
     if (ImGui::BeginMenu("Options")) {
 //      if (ImGui::BeginMenu("Default audio language")) {
 //        ImGui::MenuItem("English", nullptr, true);
@@ -872,6 +4033,26 @@ static void DrawMainMenuBar() {
         
         ImGui::EndMenu();
       }
+      
+      if (ImGui::BeginMenu("Performance")) {
+        if (ImGui::MenuItem("Idle rendering", nullptr, &IdleRendering)) SaveConfig();
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::SliderInt("Frame rate cap", &FrameRateCap, 0, 240, FrameRateCap == 0 ? "vsync" : "%d fps");
+        if (ImGui::IsItemDeactivatedAfterEdit()) SaveConfig();
+        ImGui::MenuItem("Profiler", "F3", &ProfilerOverlay);
+        ImGui::TextDisabled("CPU: %.1f%%", CPUUsage);
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::SliderInt("Memory budget", &MemoryBudget, 0, 8192, MemoryBudget == 0 ? "no limit" : "%d MiB");
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Covers the decoded audio and the external stream payloads of the active bank.\nOther open banks keep their payloads in memory.");
+        if (ImGui::IsItemDeactivatedAfterEdit()) {
+          SaveConfig();
+          EnforceMemoryBudget(PlayingStreams());
+        }
+        ImGui::TextDisabled("PCM cache: %zu streams, %.1f MB", AudioCache.items.size(), AudioCache.bytes / 1e6);
+        ImGui::TextDisabled("  %llu hits, %llu misses, %llu/%llu structs reused", (unsigned long long)AudioCache.hits, (unsigned long long)AudioCache.misses,
+          (unsigned long long)AudioCache.structs_reused, (unsigned long long)(AudioCache.structs_reused + AudioCache.structs_allocated));
+        ImGui::EndMenu();
+      }
     
       ImGui::EndMenu();
     }
@@ -886,17 +4067,138 @@ static void DrawMainMenuBar() {
   }
 }
 
-static void DrawCloseDialog() {
-  if (ImGui::BeginPopupModal("##CloseDialog", nullptr, ImGuiWindowFlags_NoDecoration)) {
-    ImGui::Text("There are unsaved changes. Exit anyway?");
-    if (ImGui::Button("Yes")) Quit = true;
+static void DrawCloseDialog() {
+  if (ImGui::BeginPopupModal("##CloseDialog", nullptr, ImGuiWindowFlags_NoDecoration)) {
+    ImGui::Text("There are unsaved changes. Exit anyway?");
+    if (ImGui::Button("Yes")) Quit = true;
+    ImGui::SameLine();
+    if (ImGui::Button("No")) {
+      ImGui::CloseCurrentPopup();
+      WantsQuit = false;
+    }
+    ImGui::EndPopup();
+  }
+}
+
+#pragma mark - Profiler overlay
+
+struct ProfileZoneStats {
+  std::string name;
+  size_t count;
+  float mean;
+  float p99;
+  float total;
+};
+
+/* Recomputed a few times per second while the overlay is open */
+static std::vector<ProfileZoneStats> ProfileStatsCache;
+static uint64_t ProfileStatsTime = 0;
+static constexpr uint64_t ProfileStatsInterval = 250'000'000;
+
+static std::vector<ProfileZoneStats> ProfileStats() {
+  std::vector<ProfileRing::Event> events;
+  Profile.Snapshot(events);
+  
+  std::map<std::string, std::vector<float>> durations;
+  for (auto& e : events) {
+    if (e.begin < ProfileResetTime) continue;
+    durations[e.zone].push_back((e.end - e.begin) / 1'000'000.0f);
+  }
+  
+  std::vector<ProfileZoneStats> stats;
+  for (auto& [name, d] : durations) {
+    ProfileZoneStats z = { name, d.size(), 0.0f, 0.0f, 0.0f };
+    for (float v : d) z.total += v;
+    z.mean = z.total / d.size();
+    size_t p = std::min(d.size() - 1, size_t(d.size() * 0.99f));
+    std::nth_element(d.begin(), d.begin() + p, d.end());
+    z.p99 = d[p];
+    stats.push_back(z);
+  }
+  
+  return stats;
+}
+
+/* Writes the recorded zones in the Chrome trace event format (chrome://tracing, Perfetto) */
+static void ExportChromeTrace(std::filesystem::path path) {
+  std::vector<ProfileRing::Event> events;
+  Profile.Snapshot(events);
+  
+  FILE *fp = fopen(path.string().c_str(), "w");
+  if (!fp) {
+    Log.push_back({ LogEntry::Type::Error, "Failed to write " + path.string() + ": " + strerror(errno) });
+    return;
+  }
+  
+  fprintf(fp, "{\"traceEvents\":[\n");
+  bool first = true;
+  for (auto& e : events) {
+    if (e.begin < ProfileResetTime) continue;
+    fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+      e.zone, e.thread, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+    first = false;
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+  
+  Log.push_back({ LogEntry::Type::Status, "Exported profile trace to " + path.string() });
+}
+
+static void DrawProfiler() {
+  ProfilerEnabled = ProfilerOverlay;
+  if (!ProfilerOverlay) return;
+  
+  ImGui::SetNextWindowBgAlpha(0.9f);
+  ImGui::SetNextWindowSize(ImVec2(420, 320), ImGuiCond_FirstUseEver);
+  if (ImGui::Begin("Profiler", &ProfilerOverlay, ImGuiWindowFlags_NoDocking)) {
+    float max = 0.0f, sum = 0.0f;
+    for (float t : FrameTimes) {
+      max = std::max(max, t);
+      sum += t;
+    }
+    
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "avg %.2f ms, max %.2f ms", sum / IM_ARRAYSIZE(FrameTimes), max);
+    ImGui::PlotHistogram("##FrameTimes", FrameTimes, IM_ARRAYSIZE(FrameTimes), FrameTimeIndex, overlay, 0.0f, std::max(max, 16.7f), ImVec2(-1, 60));
+    
+    if (ImGui::Button("Reset")) {
+      ProfileResetTime = ProfileNow();
+      ProfileStatsTime = 0;
+    }
     ImGui::SameLine();
-    if (ImGui::Button("No")) {
-      ImGui::CloseCurrentPopup();
-      WantsQuit = false;
+    if (ImGui::Button("Export Chrome trace")) ExportChromeTrace(std::filesystem::path(BasePath) / "hxtool-trace.json");
+    
+    if (ImGui::BeginTable("Zones", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingStretchProp)) {
+      ImGui::TableSetupColumn("Zone");
+      ImGui::TableSetupColumn("Count");
+      ImGui::TableSetupColumn("Mean (ms)");
+      ImGui::TableSetupColumn("p99 (ms)");
+      ImGui::TableSetupColumn("Total (ms)");
+      ImGui::TableHeadersRow();
+      
+      uint64_t now = ProfileNow();
+      if (now - ProfileStatsTime >= ProfileStatsInterval) {
+        ProfileStatsCache = ProfileStats();
+        ProfileStatsTime = now;
+      }
+      
+      for (auto& z : ProfileStatsCache) {
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", z.name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextDisabled("%zu", z.count);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", z.mean);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", z.p99);
+        ImGui::TableNextColumn();
+        ImGui::TextDisabled("%.1f", z.total);
+      }
+      
+      ImGui::EndTable();
     }
-    ImGui::EndPopup();
   }
+  ImGui::End();
 }
 
 static void Draw() {
@@ -932,53 +4234,544 @@ static void Draw() {
   DrawLog();
   DrawObjectWindow();
   DrawCloseDialog();
+  DrawProfiler();
+  DrawDiff();
+  DrawMemory();
+  DrawWorkspaceIndex();
   
+  if (ImGui::IsKeyPressed(ImGuiKey_F3, false)) ProfilerOverlay = !ProfilerOverlay;
+  if (ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_S) && hx_ctx) WantsSave = true;
   if (WantsQuit) ImGui::OpenPopup("##CloseDialog");
   
   ImGui::End();
 }
 
 
-static void LoadHXFile(std::filesystem::path path) {
+static std::vector<TaskHandle> LoadTasks;
+static uint64_t LoadGeneration = 0;
+
+/* Finished loads waiting for a save or diff to release the current contexts */
+static std::vector<std::function<void()>> DeferredLoads;
+
+static bool IsBankFile(const std::filesystem::path& path) {
   std::string extension = path.extension().string();
-  if (extension.starts_with(".hx") || extension.starts_with(".HX")) {
-    if (hx_ctx) {
-      SDL_CloseAudio();
-      AudioClear();
-      hx_context_free(&hx_ctx);
-      hx_ctx = nullptr;
-      PlayingEvent = nullptr;
-      SelectedObject = nullptr;
+  return extension.starts_with(".hx") || extension.starts_with(".HX");
+}
+
+/* Opens a bank and builds its indexes; runs on a worker. With `cache`, the sidecar of
+ * the bank is rewritten for the next time it is opened. */
+static std::unique_ptr<Bank> OpenBank(std::filesystem::path path, TaskToken& token, bool cache = false) {
+  std::unique_ptr<Bank> bank = std::make_unique<Bank>();
+  bank->path = path;
+  bank->stats = std::make_shared<LoadStats>();
+  bank->stats->path = path;
+  
+  hx_t *ctx = hx_context_alloc();
+  hx_context_callback(ctx, &ReadCB, &WriteCB, &ErrorCB, bank->stats.get());
+  
+  uint64_t begin = ProfileNow();
+  int result;
+  {
+    PROFILE_ZONE("hx_context_open");
+    result = hx_context_open(ctx, path.string().c_str());
+  }
+  bank->stats->open_nanoseconds = ProfileNow() - begin;
+  
+  if (result < 0 || token.cancelled) {
+    if (result < 0) Log.push_back({ LogEntry::Type::Error, "Failed to load file" + path.string() });
+    hx_context_free(&ctx);
+    return nullptr;
+  }
+  
+  CollectClassStats(ctx, *bank->stats);
+  
+  /* The indexes of a bank share one region, released with the bank */
+  std::shared_ptr<BankArena> memory = std::make_shared<BankArena>();
+  bank->search = std::make_shared<SearchIndex>(memory);
+  bank->references = std::make_shared<ReferenceIndex>(memory);
+  bank->memory = std::make_shared<MemoryAccount>();
+  bank->search->Build(ctx);
+  bank->references->Build(ctx);
+  bank->memory->Build(ctx, BankFileSize(bank->stats->path));
+  bank->stats->index_allocations = memory->requests.allocations;
+  bank->stats->index_blocks = memory->blocks.allocations;
+  bank->stats->index_bytes = memory->blocks.bytes;
+  if (cache) WriteSidecar(path, ctx);
+  
+  bank->ctx = ctx;
+  return bank;
+}
+
+#pragma mark - File watch
+
+/* Notices when a build regenerates a bank or resource next to the open banks. Uses inotify
+ * where available and scans the directories once a second otherwise. */
+struct FileWatch {
+  std::set<std::filesystem::path> directories;
+  std::map<std::string, SidecarKey> known;   /* last seen state of each bank and resource */
+  std::map<std::string, uint64_t> pending;   /* path -> time of the last event */
+  uint64_t last_scan = 0;
+#ifdef __linux__
+  int fd = -1;
+  std::map<int, std::filesystem::path> watches;
+#endif
+  
+  static constexpr uint64_t Settle = 500'000'000; /* writers often touch a file several times */
+  static constexpr uint64_t ScanInterval = 1'000'000'000;
+  
+  static bool Relevant(const std::filesystem::path& p) {
+    return IsBankFile(p) || IsResourceFile(p);
+  }
+  
+  void Stamp(const std::filesystem::path& directory) {
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+      SidecarKey key;
+      if (entry.is_regular_file() && Relevant(entry.path()) && ReadSidecarKey(entry.path(), key)) known[entry.path().string()] = key;
     }
+  }
+  
+  /* Follows the directories of the workspace */
+  void Sync() {
+    std::set<std::filesystem::path> wanted;
+    for (auto& bank : Workspace) wanted.insert(bank->path.parent_path());
+    if (wanted == directories) return;
     
-    current_file = path.filename();
-    work_directory = path;
-    work_directory.remove_filename();
+#ifdef __linux__
+    if (fd < 0) fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    for (auto it = watches.begin(); it != watches.end();) {
+      if (wanted.count(it->second)) { it++; continue; }
+      inotify_rm_watch(fd, it->first);
+      it = watches.erase(it);
+    }
+#endif
     
-    hx_ctx = hx_context_alloc();
-    hx_context_callback(hx_ctx, &ReadCB, &WriteCB, &ErrorCB, NULL);
+    for (const std::filesystem::path& d : directories) {
+      if (wanted.count(d)) continue;
+      std::erase_if(known, [&](auto& item) { return std::filesystem::path(item.first).parent_path() == d; });
+    }
     
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    if (hx_context_open(hx_ctx, path.string().c_str()) < 0) {
-      Log.push_back({ LogEntry::Type::Error, "Failed to load file" + path.string() });
+    for (const std::filesystem::path& d : wanted) {
+      if (directories.count(d)) continue;
+#ifdef __linux__
+      if (fd >= 0) {
+        int wd = inotify_add_watch(fd, (d.empty() ? std::filesystem::path(".") : d).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd >= 0) watches[wd] = d;
+      }
+#endif
+      Stamp(d);
+    }
+    directories = wanted;
+  }
+  
+  void Poll(uint64_t now) {
+#ifdef __linux__
+    if (fd >= 0) {
+      alignas(struct inotify_event) char buffer[4096];
+      ssize_t n;
+      while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + n;) {
+          struct inotify_event *event = reinterpret_cast<struct inotify_event*>(p);
+          auto w = watches.find(event->wd);
+          if (w != watches.end() && event->len > 0 && Relevant(event->name)) pending[(w->second / event->name).string()] = now;
+          p += sizeof(struct inotify_event) + event->len;
+        }
+      }
       return;
     }
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    Log.push_back({ LogEntry::Type::Status, "Loaded " + path.filename().string() + " in " +
-      std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / 1'000'000'000.0f) + " seconds." });
+#endif
+    
+    if (now - last_scan < ScanInterval) return;
+    last_scan = now;
+    for (const std::filesystem::path& d : directories) {
+      std::error_code ec;
+      for (auto& entry : std::filesystem::directory_iterator(d, ec)) {
+        if (!entry.is_regular_file() || !Relevant(entry.path())) continue;
+        SidecarKey key;
+        auto it = known.find(entry.path().string());
+        if (ReadSidecarKey(entry.path(), key) && (it == known.end() || it->second != key))
+          pending.try_emplace(entry.path().string(), now);
+      }
+    }
+  }
+  
+  /* Files that settled in a state different from the one last seen. They stay pending
+   * until Seen() is called for them. */
+  std::vector<std::string> Changed(uint64_t now) {
+    std::vector<std::string> out;
+    for (auto it = pending.begin(); it != pending.end();) {
+      SidecarKey key;
+      if (now - it->second < Settle) {
+        it++;
+      } else if (!ReadSidecarKey(it->first, key) || (known.count(it->first) && known[it->first] == key)) {
+        it = pending.erase(it);
+      } else {
+        out.push_back(it->first);
+        it++;
+      }
+    }
+    return out;
+  }
+  
+  void Seen(const std::string& path) {
+    pending.erase(path);
+    SidecarKey key;
+    if (ReadSidecarKey(path, key)) known[path] = key;
+  }
+  
+  /* After hxtool wrote the files itself */
+  void Refresh() {
+    for (auto it = known.begin(); it != known.end();) {
+      if (ReadSidecarKey(it->first, it->second)) it++;
+      else it = known.erase(it);
+    }
+    for (const std::filesystem::path& d : directories) Stamp(d);
+  }
+};
+
+static FileWatch Watch;
+
+/* A reloaded bank waiting for the workers reading the contexts to finish */
+static std::function<void()> PendingMerge;
+
+static void RefreshWatchedFiles() {
+  Watch.Refresh();
+}
+
+/* Closes the cached handle of `filename`; the next read opens the file again */
+static void DropFileStream(const std::string& filename) {
+  std::lock_guard<std::mutex> lock(FileMutex);
+  auto it = FileMap.find(filename);
+  if (it != FileMap.end()) {
+    delete it->second;
+    FileMap.erase(it);
+  }
+}
+
+static void StopPlayback() {
+  SDL_CloseAudio();
+  AudioClear();
+  AudioCache.Clear();
+  PlayingEvent = nullptr;
+}
+
+/* A resource file changed: cached handles are dropped and every stream read from it is
+ * released, so the next playback or save reads the new contents */
+static void ReloadResource(const std::filesystem::path& path) {
+  DropFileStream(path.string());
+  
+  /* Decoded audio may come from the old contents */
+  StopPlayback();
+  
+  size_t released = 0, kept = 0;
+  for (auto& bank : Workspace) {
+    if (!bank->ctx) continue;
+    bool active = bank.get() == ActiveBank;
+    for (hx_size_t i = 0; i < hx_context_num_entries(bank->ctx); i++) {
+      hx_entry_t *e = hx_context_get_entry(bank->ctx, i);
+      if (e->i_class != HX_CLASS_WAVE_FILE_ID_OBJECT) continue;
+      hx_wave_file_id_object_t *data = static_cast<hx_wave_file_id_object_t*>(e->data);
+      hx_audio_stream_t *s = data->audio_stream;
+      if (!s || data->ext_stream_size == 0) continue;
+      if (bank->path.parent_path() / std::filesystem::path(data->ext_stream_filename).filename() != path) continue;
+      
+      /* Already evicted: the next reload takes the new bytes instead of checking for the old ones */
+      if (!s->data) {
+        if (active && Payloads.payloads.count(s)) Payloads.payloads[s].hash = 0;
+        if (!active) bank->evicted.erase(s);
+        continue;
+      }
+      
+      if (active) {
+        auto payload = Payloads.payloads.find(s);
+        if (payload == Payloads.payloads.end() || !Payloads.Evictable(s, payload->second)) {
+          kept++;
+          continue;
+        }
+        Payloads.Evict(s, false);
+      } else {
+        if (bank->dirty_streams || s->size != data->ext_stream_size) {
+          kept++;
+          continue;
+        }
+        hx_audio_stream_t keep = *s;
+        hx_audio_stream_dealloc(s);
+        *s = keep;
+        s->data = nullptr;
+        s->size = 0;
+        bank->memory->Update(e);
+      }
+      released++;
+    }
+  }
+  
+  Log.push_back({ LogEntry::Type::Info, path.filename().string() + " changed on disk: " + std::to_string(released) + " streams will be read again" });
+  if (kept > 0) Log.push_back({ LogEntry::Type::Warning, std::to_string(kept) + " edited streams, or streams that cannot be read back, still use the previous " + path.filename().string() });
+}
+
+/* Swaps the changed entries of a freshly parsed copy into `bank`. Entries keep their
+ * addresses, so selections, dirty sets and indexes stay valid. When entries were added
+ * or removed the bank takes over the fresh context instead. */
+static void MergeReload(std::shared_ptr<Bank> bank, std::shared_ptr<Bank> fresh,
+  const std::vector<EntryDigest>& before, const std::vector<EntryDigest>& after, uint64_t begin) {
+  bool active = bank.get() == ActiveBank;
+  if (BankDirty(bank.get())) {
+    Log.push_back({ LogEntry::Type::Warning, bank->path.filename().string() + " changed on disk but has unsaved edits; not reloaded" });
+    hx_context_free(&fresh->ctx);
+    return;
+  }
+  
+  if (active) StopPlayback();
+  
+  bool same = before.size() == after.size();
+  for (size_t i = 0; i < before.size() && same; i++) same = before[i].cuuid == after[i].cuuid && before[i].i_class == after[i].i_class;
+  
+  std::string name = bank->path.filename().string();
+  if (same) {
+    size_t changed = 0;
+    for (size_t i = 0; i < after.size(); i++) {
+      hx_entry_t *e = hx_context_get_entry(bank->ctx, i);
+      hx_entry_t *now = hx_context_get_entry(fresh->ctx, i);
+      e->file_offset = now->file_offset;
+      
+      /* External payloads are followed through their resource file instead */
+      if (before[i].hash == after[i].hash) continue;
+      
+      std::swap(e->data, now->data);
+      if (e->i_class == HX_CLASS_EVENT_RESOURCE_DATA && bank->search->Update(e)) SearchStale = true;
+      bank->references->Update(e);
+      bank->memory->Update(e);
+      changed++;
+    }
+    hx_context_free(&fresh->ctx);
+    if (active) Payloads.Build(hx_ctx, Payloads.Hashes());
+    
+    Log.push_back({ LogEntry::Type::Status, "Reloaded " + name + ": " + std::to_string(changed) + " of " + std::to_string(after.size()) +
+      " entries changed (" + std::to_string((ProfileNow() - begin) / 1e9) + " seconds)" });
+  } else {
+    /* The old context still reads through the stats it was opened with */
+    hx_t *old = bank->ctx;
+    std::shared_ptr<LoadStats> stats = bank->stats;
+    bank->ctx = fresh->ctx;
+    bank->stats = fresh->stats;
+    bank->search = fresh->search;
+    bank->references = fresh->references;
+    bank->memory = fresh->memory;
+    bank->results.clear();
+    fresh->ctx = nullptr;
+    
+    if (active) {
+      ActiveBank = nullptr;
+      ActivateBank(bank.get());
+    }
+    hx_context_free(&old);
+    SearchStale = true;
+    
+    Log.push_back({ LogEntry::Type::Status, "Reopened " + name + ": entries were added or removed (" +
+      std::to_string((ProfileNow() - begin) / 1e9) + " seconds)" });
+  }
+  
+  GlobalIndex = nullptr;
+  BuildGlobalIndex();
+}
+
+static void ReloadBank(std::shared_ptr<Bank> bank) {
+  Reloading = true;
+  StreamReaders++;
+  uint64_t generation = WorkspaceGeneration;
+  /* A bank replaced by rename would otherwise be parsed again from the old inode */
+  DropFileStream((bank->path.parent_path() / bank->path.filename()).string());
+  
+  Scheduler->Submit(TaskPriority::Batch, [=](TaskToken& token) {
+    uint64_t begin = ProfileNow();
+    std::shared_ptr<Bank> fresh = OpenBank(bank->path, token, true);
+    std::vector<EntryDigest> before, after;
+    if (fresh) {
+      /* Evicted or not, an external payload compares by where it lives */
+      before = DigestContext(bank->ctx, true);
+      after = DigestContext(fresh->ctx, true);
+    }
     
-    SelectedEvent = hx_context_get_entry(hx_ctx, 0);
+    RunOnMainThread([=]() {
+      StreamReaders--;
+      if (!fresh) {
+        Reloading = false;
+        return;
+      }
+      
+      PendingMerge = [=]() {
+        if (generation != WorkspaceGeneration || std::find(Workspace.begin(), Workspace.end(), bank) == Workspace.end()) {
+          hx_context_free(&fresh->ctx);
+          return;
+        }
+        MergeReload(bank, fresh, before, after, begin);
+      };
+    });
+  });
+}
+
+/* Called once per main loop iteration */
+static void CheckWatchedFiles() {
+  Watch.Sync();
+  uint64_t now = ProfileNow();
+  Watch.Poll(now);
+  
+  /* Nothing is swapped while a worker reads the contexts */
+  if (Saving || StreamReaders > 0 || Indexing) return;
+  if (PendingMerge) {
+    std::function<void()> merge = std::move(PendingMerge);
+    PendingMerge = nullptr;
+    Reloading = false;
+    merge();
+    return;
+  }
+  if (Reloading || LoadsPending > 0) return;
+  
+  for (const std::string& changed : Watch.Changed(now)) {
+    std::filesystem::path path(changed);
+    Watch.Seen(changed);
+    if (IsResourceFile(path)) {
+      ReloadResource(path);
+      PendingFrames = 3;
+      continue;
+    }
     
-    SDL_SetWindowTitle(Window, ("hxtool - " + current_file.string()).c_str());
+    auto bank = std::find_if(Workspace.begin(), Workspace.end(), [&](auto& b) { return b->path == path; });
+    if (bank == Workspace.end() || !(*bank)->ctx) continue;
+    if (BankDirty(bank->get())) {
+      Log.push_back({ LogEntry::Type::Warning, path.filename().string() + " changed on disk but has unsaved edits; not reloaded" });
+      continue;
+    }
+    Log.push_back({ LogEntry::Type::Info, path.filename().string() + " changed on disk, reloading" });
+    ReloadBank(*bank);
+    /* One bank at a time; the others stay pending until it is merged */
+    break;
+  }
+}
+
+/* Opens banks, and every bank in the directories among `inputs`, in parallel. The current workspace stays
+ * until the first new bank is ready. All banks read through the shared FileMap, so the
+ * .hst/.hos resources they have in common are opened once. A bank with a valid sidecar
+ * is listed right away and parsed on the batch lane behind the banks that have none. */
+static void LoadHXFile(const std::vector<std::filesystem::path>& inputs) {
+  std::vector<std::filesystem::path> paths;
+  std::error_code ec;
+  for (const std::filesystem::path& path : inputs) {
+    if (std::filesystem::is_directory(path, ec)) {
+      for (auto& entry : std::filesystem::directory_iterator(path, ec))
+        if (entry.is_regular_file() && IsBankFile(entry.path())) paths.push_back(entry.path());
+    } else if (IsBankFile(path) && std::filesystem::exists(path, ec)) {
+      paths.push_back(path);
+    } else {
+      Log.push_back({ LogEntry::Type::Warning, "Not a bank or folder of banks: " + path.string() });
+    }
+  }
+  
+  std::sort(paths.begin(), paths.end());
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+  if (paths.empty()) return;
+  std::string source = inputs.size() == 1 ? inputs.front().string() : std::to_string(inputs.size()) + " paths";
+  
+  /* A newer drop supersedes a load that is still running. Its tasks that have not started
+   * never run, so neither their previews nor their count may wait for them. */
+  for (TaskHandle& task : LoadTasks) task->cancelled = true;
+  LoadTasks.clear();
+  size_t listed = Workspace.size();
+  Workspace.erase(std::remove_if(Workspace.begin(), Workspace.end(), [](auto& b) { return !b->ctx; }), Workspace.end());
+  if (Workspace.size() != listed) SearchStale = true;
+  
+  uint64_t generation = ++LoadGeneration;
+  std::shared_ptr<size_t> remaining = std::make_shared<size_t>(paths.size());
+  uint64_t begin = ProfileNow();
+  
+  LoadsPending = paths.size();
+  for (const std::filesystem::path& p : paths) {
+    std::shared_ptr<Bank> preview;
+    if (std::shared_ptr<Sidecar> sidecar = LoadSidecar(p)) {
+      if (WorkspaceGeneration != generation) {
+        /* Banks given on the command line get here before SDL is initialized */
+        if (!Workspace.empty()) CloseWorkspace();
+        WorkspaceGeneration = generation;
+      }
+      
+      preview = std::make_shared<Bank>();
+      preview->path = p;
+      preview->search = PreviewIndex(*sidecar);
+      preview->sidecar = sidecar;
+      auto at = std::upper_bound(Workspace.begin(), Workspace.end(), p, [](auto& path, auto& b) { return path < b->path; });
+      Workspace.insert(at, preview);
+      SearchStale = true;
+    }
     
+    TaskPriority priority = preview ? TaskPriority::Batch : TaskPriority::Interactive;
+    LoadTasks.push_back(Scheduler->Submit(priority, [=](TaskToken& token) {
+      std::shared_ptr<Bank> bank = OpenBank(p, token, !preview);
+      
+      std::function<void()> finish = [=]() {
+        if (generation == LoadGeneration) LoadsPending--;
+        /* A preview is only ever replaced by its own load */
+        auto previewed = std::find(Workspace.begin(), Workspace.end(), preview);
+        if (preview && previewed != Workspace.end() && (!bank || generation != LoadGeneration)) {
+          Workspace.erase(previewed);
+          SearchStale = true;
+        }
+        
+        if (generation != LoadGeneration) {
+          if (bank) hx_context_free(&bank->ctx);
+          return;
+        }
+        
+        if (bank) {
+          if (WorkspaceGeneration != generation) {
+            CloseWorkspace();
+            WorkspaceGeneration = generation;
+          }
+          
+          Log.push_back({ LogEntry::Type::Status, "Loaded " + p.filename().string() + " in " +
+            std::to_string(bank->stats->open_nanoseconds / 1e9) + " seconds." });
+          if (paths.size() == 1) LogLoadStats(*bank->stats);
+          
+          if (preview && previewed != Workspace.end()) {
+            *previewed = bank;
+          } else {
+            auto at = std::upper_bound(Workspace.begin(), Workspace.end(), bank->path, [](auto& path, auto& b) { return path < b->path; });
+            Workspace.insert(at, bank);
+          }
+          SearchStale = true;
+          if (!ActiveBank) ActivateBank(bank.get());
+          UpdateWindowTitle();
+        }
+        
+        if (--*remaining == 0 && paths.size() > 1) {
+          Log.push_back({ LogEntry::Type::Status, "Opened " + std::to_string(Workspace.size()) + " of " + std::to_string(paths.size()) +
+            " banks from " + source + " in " + std::to_string((ProfileNow() - begin) / 1e9) + " seconds." });
+          BuildGlobalIndex();
+        }
+      };
+      
+      /* Swapping the workspace frees contexts, so it waits for any save or diff reading one */
+      RunOnMainThread([finish]() {
+        if (Saving || StreamReaders > 0) DeferredLoads.push_back(finish);
+        else finish();
+      });
+    }));
   }
 }
 
+static void FinishDeferredLoads() {
+  if (DeferredLoads.empty() || Saving || StreamReaders > 0) return;
+  std::vector<std::function<void()>> loads;
+  loads.swap(DeferredLoads);
+  for (auto& finish : loads) finish();
+}
+
 static int DrawUI(void* = nullptr, SDL_Event *event = nullptr) {
   if (event) {
     if (event->window.event != SDL_WINDOWEVENT_EXPOSED) return 0;
   }
   
+  uint64_t frame_begin = ProfileNow();
+  
   ImGui_ImplSDLRenderer2_NewFrame();
   ImGui_ImplSDL2_NewFrame();
   ImGui::NewFrame();
@@ -994,11 +4787,17 @@ static int DrawUI(void* = nullptr, SDL_Event *event = nullptr) {
   ImGui_ImplSDLRenderer2_RenderDrawData(ImGui::GetDrawData(), Renderer);
   SDL_RenderPresent(Renderer);
   
+  uint64_t frame_end = ProfileNow();
+  FrameTimes[FrameTimeIndex] = (frame_end - frame_begin) / 1'000'000.0f;
+  FrameTimeIndex = (FrameTimeIndex + 1) % IM_ARRAYSIZE(FrameTimes);
+  if (ProfilerEnabled) Profile.Record("Frame", frame_begin, frame_end);
+  
   return 1;
 }
 
 static void HandleEvent(SDL_Event *e) {
   ImGui_ImplSDL2_ProcessEvent(e);
+  PendingFrames = 3;
   switch (e->type) {
     case SDL_DROPFILE:
       DroppedFile = e->drop.file;
@@ -1010,14 +4809,398 @@ static void HandleEvent(SDL_Event *e) {
   }
 }
 
+static void WaitForEvents() {
+  SDL_Event e;
+  if (PendingFrames == 0 && !NeedsContinuousRedraw()) {
+    /* Sleep until something happens; wake periodically so the text caret still blinks */
+    int timeout = ImGui::GetIO().WantTextInput ? 250 : 1000;
+    if (SDL_WaitEventTimeout(&e, timeout)) HandleEvent(&e);
+    else if (ImGui::GetIO().WantTextInput) PendingFrames = 1;
+  }
+  while (SDL_PollEvent(&e)) HandleEvent(&e);
+}
+
+#pragma mark - Benchmark
+
+struct BenchResult {
+  std::string name;
+  std::vector<double> ms;
+  uint64_t items = 0;
+  uint64_t bytes = 0;
+};
+
+struct BenchOptions {
+  std::filesystem::path bank;
+  std::filesystem::path output;
+  int iterations = 5;
+  int waves = 64;
+  int seconds = 4;
+  int channels = 2;
+  int sample_rate = 44100;
+  bool external = false;
+};
+
+/* Runs `fn` `iterations` times; `fn` reports how many items and bytes one pass processed */
+static BenchResult Bench(const char* name, int iterations, std::function<void(uint64_t& items, uint64_t& bytes)> fn) {
+  BenchResult r;
+  r.name = name;
+  for (int i = 0; i < iterations; i++) {
+    r.items = r.bytes = 0;
+    uint64_t begin = ProfileNow();
+    fn(r.items, r.bytes);
+    r.ms.push_back((ProfileNow() - begin) / 1e6);
+  }
+  return r;
+}
+
+/* A PCM stream of a few mixed sines plus noise, so encoders cannot take shortcuts */
+static hx_audio_stream_t* SyntheticStream(const BenchOptions& opt, uint32_t seed) {
+  hx_audio_stream_t *s = (hx_audio_stream_t*)calloc(1, sizeof(*s));
+  s->info.fmt = HX_FORMAT_PCM;
+  s->info.num_channels = opt.channels;
+  s->info.sample_rate = opt.sample_rate;
+  s->info.num_samples = opt.seconds * opt.sample_rate;
+  s->wavefile_cuuid = 0xB000000000000000ull | seed;
+  s->size = s->info.num_samples * opt.channels * sizeof(short);
+  s->data = (short*)malloc(s->size);
+  
+  uint32_t noise = seed * 2654435761u + 1;
+  for (unsigned int i = 0; i < s->info.num_samples * opt.channels; i++) {
+    noise = noise * 1664525u + 1013904223u;
+    float t = float(i / opt.channels) / opt.sample_rate;
+    float v = 0.5f * sinf(2.0f * M_PI * (220.0f + seed % 7 * 55.0f) * t) + 0.25f * sinf(2.0f * M_PI * 3520.0f * t);
+    v += 0.1f * (float(noise >> 16) / 32768.0f - 1.0f);
+    s->data[i] = short(std::clamp(v, -1.0f, 1.0f) * 32767.0f);
+  }
+  return s;
+}
+
+static void FreeStream(hx_audio_stream_t *s) {
+  if (!s) return;
+  hx_audio_stream_dealloc(s);
+  free(s);
+}
+
+/* Writes a 16-bit PCM stream as a .wav file */
+static bool WriteWav(std::filesystem::path path, const hx_audio_stream_t *pcm) {
+  FILE *fp = fopen(path.string().c_str(), "wb");
+  if (!fp) return false;
+  uint32_t rate = pcm->info.sample_rate, size = pcm->size;
+  uint16_t channels = pcm->info.num_channels, bits = 16, format = 1, align = channels * 2;
+  uint32_t byte_rate = rate * align, chunk = 36 + size, fmt_size = 16;
+  fwrite("RIFF", 1, 4, fp); fwrite(&chunk, 4, 1, fp); fwrite("WAVEfmt ", 1, 8, fp);
+  fwrite(&fmt_size, 4, 1, fp); fwrite(&format, 2, 1, fp); fwrite(&channels, 2, 1, fp);
+  fwrite(&rate, 4, 1, fp); fwrite(&byte_rate, 4, 1, fp); fwrite(&align, 2, 1, fp); fwrite(&bits, 2, 1, fp);
+  fwrite("data", 1, 4, fp); fwrite(&size, 4, 1, fp);
+  bool ok = fwrite(pcm->data, 1, size, fp) == size;
+  fclose(fp);
+  return ok;
+}
+
+static void PrintBenchJson(FILE *fp, const BenchOptions& opt, const std::vector<BenchResult>& results) {
+  fprintf(fp, "{\n  \"timestamp\": %lld,\n  \"threads\": %u,\n", (long long)time(nullptr), std::thread::hardware_concurrency());
+  fprintf(fp, "  \"bank\": \"%s\",\n  \"iterations\": %d,\n", JsonEscape(opt.bank.string()).c_str(), opt.iterations);
+  fprintf(fp, "  \"synthetic\": { \"waves\": %d, \"seconds\": %d, \"channels\": %d, \"sample_rate\": %d, \"external\": %s },\n",
+    opt.waves, opt.seconds, opt.channels, opt.sample_rate, opt.external ? "true" : "false");
+  fprintf(fp, "  \"results\": [");
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& r = results[i];
+    std::vector<double> sorted = r.ms;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0.0;
+    for (double v : sorted) mean += v;
+    mean /= std::max<size_t>(1, sorted.size());
+    double median = sorted.empty() ? 0.0 : sorted[sorted.size() / 2];
+    double mbps = median > 0.0 ? (r.bytes / 1e6) / (median / 1e3) : 0.0;
+    fprintf(fp, "%s\n    { \"name\": \"%s\", \"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, \"items\": %llu, \"bytes\": %llu, \"mb_per_s\": %.2f }",
+      i ? "," : "", r.name.c_str(), sorted.empty() ? 0.0 : sorted.front(), median, mean, (unsigned long long)r.items, (unsigned long long)r.bytes, mbps);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+}
+
+/* --bench [options] [bank]: time the hot paths and print JSON results.
+ * Synthetic streams cover decode/encode/export; bank-level stages need a real bank
+ * since libhx2 has no API to construct entries from scratch. */
+static int BenchCommand(const BenchOptions& opt) {
+  std::vector<BenchResult> results;
+  std::filesystem::path tmp = std::filesystem::temp_directory_path() / "hxtool-bench";
+  std::filesystem::create_directories(tmp);
+  
+  /* Synthetic streams */
+  std::vector<hx_audio_stream_t*> pcm, encoded;
+  for (int i = 0; i < opt.waves; i++) pcm.push_back(SyntheticStream(opt, i));
+  
+  results.push_back(Bench("encode", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+    for (auto e : encoded) FreeStream(e);
+    encoded.clear();
+    for (auto s : pcm) {
+      hx_audio_stream_t *out = (hx_audio_stream_t*)calloc(1, sizeof(*out));
+      out->info = s->info;
+      out->info.fmt = HX_FORMAT_DSP;
+      if (hx_audio_convert(s, out) < 0) { free(out); continue; }
+      encoded.push_back(out);
+      items++;
+      bytes += s->size;
+    }
+  }));
+  
+  results.push_back(Bench("decode", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+    for (auto s : encoded) {
+      hx_audio_stream_t out = {};
+      out.info.fmt = HX_FORMAT_PCM;
+      if (hx_audio_convert(s, &out) < 0) continue;
+      items++;
+      bytes += out.size;
+      hx_audio_stream_dealloc(&out);
+    }
+  }));
+  
+  results.push_back(Bench("export", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+    for (auto s : pcm) {
+      if (!WriteWav(tmp / (std::to_string(items) + ".wav"), s)) continue;
+      items++;
+      bytes += s->size;
+    }
+  }));
+  
+  if (opt.external) {
+    /* Lay the encoded streams out in a resource file and read them back through ReadCB */
+    std::filesystem::path hst = tmp / "synthetic.hst";
+    std::vector<std::pair<size_t, size_t>> ranges;
+    {
+      std::ofstream out(hst, std::ios::binary | std::ios::trunc);
+      size_t offset = 0;
+      for (auto s : encoded) {
+        size_t size = hx_audio_stream_size(s);
+        out.write((const char*)s->data, size);
+        ranges.push_back({ offset, size });
+        offset += size;
+      }
+    }
+    
+    work_directory = tmp / "";
+    results.push_back(Bench("external_read", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+      for (auto [offset, size] : ranges) {
+        size_t sz = size;
+        char *data = ReadCB(hst.string().c_str(), offset, &sz, nullptr);
+        if (!data) continue;
+        free(data);
+        items++;
+        bytes += sz;
+      }
+    }));
+  }
+  
+  for (auto s : pcm) FreeStream(s);
+  for (auto s : encoded) FreeStream(s);
+  
+  /* Bank stages */
+  if (!opt.bank.empty()) {
+    work_directory = opt.bank;
+    work_directory.remove_filename();
+    
+    hx_t *ctx = nullptr;
+    results.push_back(Bench("open", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+      if (ctx) hx_context_free(&ctx);
+      ctx = hx_context_alloc();
+      hx_context_callback(ctx, &ReadCB, &WriteCB, &ErrorCB, nullptr);
+      if (hx_context_open(ctx, opt.bank.string().c_str()) < 0) return;
+      items = hx_context_num_entries(ctx);
+      bytes = std::filesystem::file_size(opt.bank);
+    }));
+    
+    if (!ctx || hx_context_num_entries(ctx) == 0) {
+      fprintf(stderr, "failed to load %s\n", opt.bank.string().c_str());
+      if (ctx) hx_context_free(&ctx);
+      return 1;
+    }
+    
+    std::vector<uint64_t> cuuids;
+    for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) cuuids.push_back(hx_context_get_entry(ctx, i)->cuuid);
+    std::shuffle(cuuids.begin(), cuuids.end(), std::mt19937(1234));
+    
+    results.push_back(Bench("lookup", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+      for (uint64_t c : cuuids) items += hx_context_find_entry(ctx, c) != nullptr;
+    }));
+    
+    results.push_back(Bench("graph", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+      std::vector<uint64_t> links;
+      for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) {
+        links.clear();
+        CollectLinks(hx_context_get_entry(ctx, i), links);
+        for (uint64_t l : links) items += hx_context_find_entry(ctx, l) != nullptr;
+      }
+    }));
+    
+    results.push_back(Bench("bank_decode", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+      for (hx_size_t i = 0; i < hx_context_num_entries(ctx); i++) {
+        hx_entry_t *e = hx_context_get_entry(ctx, i);
+        if (e->i_class != HX_CLASS_WAVE_FILE_ID_OBJECT) continue;
+        hx_wave_file_id_object_t *obj = static_cast<hx_wave_file_id_object_t*>(e->data);
+        if (!obj->audio_stream || !obj->audio_stream->data) continue;
+        hx_audio_stream_t out = {};
+        out.info.fmt = HX_FORMAT_PCM;
+        if (hx_audio_convert(obj->audio_stream, &out) < 0) continue;
+        items++;
+        bytes += out.size;
+        hx_audio_stream_dealloc(&out);
+      }
+    }));
+    
+    std::filesystem::path written = tmp / ("bench" + opt.bank.extension().string());
+    results.push_back(Bench("write", opt.iterations, [&](uint64_t& items, uint64_t& bytes) {
+      work_directory = tmp / "";
+      hx_context_write(ctx, written.filename().string().c_str(), hx_context_version(ctx));
+      size_t total = 0;
+      CommitWriters(true, &total);
+      items = hx_context_num_entries(ctx);
+      bytes = total;
+    }));
+    
+    hx_context_free(&ctx);
+  }
+  
+  std::filesystem::remove_all(tmp);
+  
+  FILE *fp = opt.output.empty() ? stdout : fopen(opt.output.string().c_str(), "w");
+  if (!fp) {
+    fprintf(stderr, "failed to open %s: %s\n", opt.output.string().c_str(), strerror(errno));
+    return 1;
+  }
+  PrintBenchJson(fp, opt, results);
+  if (fp != stdout) fclose(fp);
+  return 0;
+}
+
+#pragma mark - Command line
+
+/* --load-stats <file>: print the load breakdown of a bank as JSON */
+static int LoadStatsCommand(std::filesystem::path path) {
+  work_directory = path;
+  work_directory.remove_filename();
+  
+  LoadStats stats;
+  stats.path = path;
+  
+  hx_t *ctx = hx_context_alloc();
+  hx_context_callback(ctx, &ReadCB, &WriteCB, &ErrorCB, &stats);
+  
+  uint64_t begin = ProfileNow();
+  if (hx_context_open(ctx, path.string().c_str()) < 0) {
+    fprintf(stderr, "failed to load %s\n", path.string().c_str());
+    hx_context_free(&ctx);
+    return 1;
+  }
+  stats.open_nanoseconds = ProfileNow() - begin;
+  
+  CollectClassStats(ctx, stats);
+  {
+    std::shared_ptr<BankArena> memory = std::make_shared<BankArena>();
+    SearchIndex search(memory);
+    ReferenceIndex references(memory);
+    search.Build(ctx);
+    references.Build(ctx);
+    stats.index_allocations = memory->requests.allocations;
+    stats.index_blocks = memory->blocks.allocations;
+    stats.index_bytes = memory->blocks.bytes;
+  }
+  PrintLoadStatsJson(stdout, stats);
+  hx_context_free(&ctx);
+  return 0;
+}
+
+/* --memory <file>: print where the memory of a loaded bank goes as JSON */
+static int MemoryCommand(std::filesystem::path path) {
+  LoadStats stats;
+  hx_t *ctx = OpenContext(path, &stats);
+  if (!ctx) {
+    fprintf(stderr, "failed to load %s\n", path.string().c_str());
+    return 1;
+  }
+  
+  std::shared_ptr<BankArena> memory = std::make_shared<BankArena>();
+  SearchIndex search(memory);
+  ReferenceIndex references(memory);
+  MemoryAccount account;
+  search.Build(ctx);
+  references.Build(ctx);
+  account.Build(ctx, BankFileSize(path));
+  
+  PrintMemoryJson(stdout, path, MemoryLines(account, memory.get(), hx_context_version(ctx)));
+  hx_context_free(&ctx);
+  return 0;
+}
+
+/* --diff <a> <b>: print the structural differences between two banks as JSON */
+static int DiffCommand(std::filesystem::path a, std::filesystem::path b) {
+  LoadStats sa, sb;
+  hx_t *ca = OpenContext(a, &sa);
+  hx_t *cb = OpenContext(b, &sb);
+  if (!ca || !cb) {
+    fprintf(stderr, "failed to load %s\n", (!ca ? a : b).string().c_str());
+    if (ca) hx_context_free(&ca);
+    if (cb) hx_context_free(&cb);
+    return 1;
+  }
+  
+  BankDiff diff = DiffDigests(DigestContext(ca), DigestContext(cb));
+  diff.a = a;
+  diff.b = b;
+  PrintDiffJson(stdout, diff, hx_context_version(ca));
+  
+  hx_context_free(&ca);
+  hx_context_free(&cb);
+  return 0;
+}
+
 int main(int argc, char** argv) {
+  if (argc >= 3 && std::string(argv[1]) == "--load-stats") {
+    Headless = true;
+    return LoadStatsCommand(argv[2]);
+  }
+  
+  if (argc >= 3 && std::string(argv[1]) == "--memory") {
+    Headless = true;
+    return MemoryCommand(argv[2]);
+  }
+  
+  if (argc >= 4 && std::string(argv[1]) == "--diff") {
+    Headless = true;
+    Scheduler = std::make_unique<TaskScheduler>(std::max(1u, std::thread::hardware_concurrency()));
+    return DiffCommand(argv[2], argv[3]);
+  }
+  
+  if (argc >= 2 && std::string(argv[1]) == "--bench") {
+    Headless = true;
+    BenchOptions opt;
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      bool value = i + 1 < argc;
+      if (arg == "--iterations" && value) opt.iterations = std::max(1, atoi(argv[++i]));
+      else if (arg == "--waves" && value) opt.waves = std::max(0, atoi(argv[++i]));
+      else if (arg == "--seconds" && value) opt.seconds = std::max(1, atoi(argv[++i]));
+      else if (arg == "--channels" && value) opt.channels = std::clamp(atoi(argv[++i]), 1, 2);
+      else if (arg == "--rate" && value) opt.sample_rate = std::clamp(atoi(argv[++i]), 8000, 96000);
+      else if (arg == "--external") opt.external = true;
+      else if (arg == "--out" && value) opt.output = argv[++i];
+      else opt.bank = arg;
+    }
+    return BenchCommand(opt);
+  }
+  
+  /* Banks named on the command line are parsed on the workers while the window, renderer
+   * and config come up; their results are picked up by the first frames */
+  std::vector<std::filesystem::path> inputs;
+  for (int i = 1; i < argc; i++) if (argv[i][0] != '-') inputs.push_back(argv[i]); /* e.g. -psn_ from the macOS Finder */
+  BasePath = SDL_GetBasePath();
+  Scheduler = std::make_unique<TaskScheduler>(std::max(1u, std::thread::hardware_concurrency()));
+  if (!inputs.empty()) LoadHXFile(inputs);
+  
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
   Window = SDL_CreateWindow("hxtool", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, W, H, SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
   Renderer = SDL_CreateRenderer(Window, -1, SDL_RENDERER_PRESENTVSYNC);
   SDL_SetWindowMinimumSize(Window, W, H);
   
-  BasePath = SDL_GetBasePath();
-  
   IMGUI_CHECKVERSION();
   ImGui::CreateContext();
   
@@ -1029,24 +5212,49 @@ int main(int argc, char** argv) {
   ImGui_ImplSDL2_InitForSDLRenderer(Window, Renderer);
   ImGui_ImplSDLRenderer2_Init(Renderer);
   
-  Log.push_back({ LogEntry::Type::Info, "Drag and drop: .hxc, .hx2, .hxg" });
+  if (inputs.empty()) Log.push_back({ LogEntry::Type::Info, "Drag and drop: .hxc, .hx2, .hxg, or a folder of banks" });
   
   Style();
   LoadConfig();
   
   SDL_AddEventWatch(DrawUI, nullptr);
+  WakeEventType = SDL_RegisterEvents(1);
   
   while (!Quit) {
-    SDL_Event e;
-    while (SDL_PollEvent(&e)) HandleEvent(&e);
+    WaitForEvents();
+    Uint64 frame_begin = SDL_GetPerformanceCounter();
     
-    DrawUI();
+    DispatchMainThreadTasks();
     
-    if (WantsQuit) Quit = true;
-    if (!DroppedFile.empty()) LoadHXFile(DroppedFile);
-    DroppedFile.clear();
+    bool continuous = NeedsContinuousRedraw();
+    if (PendingFrames > 0 || continuous) {
+      DrawUI();
+      /* Draw one more frame once playback or background work settles */
+      PendingFrames = continuous ? 1 : PendingFrames - 1;
+      LimitFrameRate(frame_begin);
+    }
+    
+    SampleCPUUsage();
+    
+    if (WantsSave && hx_ctx) Save(hx_context_version(hx_ctx));
+    WantsSave = false;
+    
+    if (WantsQuit && !UnsavedChanges() && !Saving) Quit = true;
+    
+    /* A dropped bank replaces the context, so it waits for the save and any diff reading it */
+    if (!DroppedFile.empty() && !Saving && StreamReaders == 0) {
+      LoadHXFile({ DroppedFile });
+      DroppedFile.clear();
+    }
+    
+    ApplyDeferredEdits();
+    FinishDeferredLoads();
+    CheckWatchedFiles();
   }
   
+  for (TaskHandle& task : LoadTasks) task->cancelled = true;
+  Scheduler.reset();
+  
   SaveConfig();
   SDL_free(BasePath);
   